@@ -0,0 +1,136 @@
+#include "arena.h"
+
+BuildArena::~BuildArena()
+{
+    release();
+}
+
+BuildArena::BuildArena(BuildArena &&other) noexcept
+{
+    chunks.swap(other.chunks);
+    currentChunk = other.currentChunk;
+    cursor = other.cursor;
+    chunkEnd = other.chunkEnd;
+    usedBeforeChunk = other.usedBeforeChunk;
+    peakUsed = other.peakUsed;
+
+    other.currentChunk = 0;
+    other.cursor = other.chunkEnd = NULL;
+    other.usedBeforeChunk = other.peakUsed = 0;
+}
+
+void *BuildArena::allocate(size_t size, size_t alignment)
+{
+    char *p = (char *)(((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+    if (cursor == NULL || p + size > chunkEnd)
+    {
+        useNextChunk(size + alignment);
+        p = (char *)(((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+
+    cursor = p + size;
+    peakUsed = max(peakUsed, getUsedBytes());
+
+    return p;
+}
+
+string_view BuildArena::copy(const char *text, size_t length)
+{
+    char *p = (char *)allocate(length, 1);
+    memcpy(p, text, length);
+
+    return string_view(p, length);
+}
+
+string_view BuildArena::append(string_view string, const char *text, size_t length, char separator)
+{
+    if (string.empty())
+        return copy(text, length);
+
+    size_t grow = length + 1; // Text & separator
+
+    /* Last allocation: Extend in place */
+    if (string.data() + string.length() == cursor && cursor + grow <= chunkEnd)
+    {
+        *cursor = separator;
+        memcpy(cursor + 1, text, length);
+        cursor += grow;
+        peakUsed = max(peakUsed, getUsedBytes());
+
+        return string_view(string.data(), string.length() + grow);
+    }
+
+    /* Otherwise: Copy to a new place */
+    char *p = (char *)allocate(string.length() + grow, 1);
+    memcpy(p, string.data(), string.length());
+    p[string.length()] = separator;
+    memcpy(p + string.length() + 1, text, length);
+
+    return string_view(p, string.length() + grow);
+}
+
+void BuildArena::useNextChunk(size_t minSize)
+{
+    if (cursor != NULL)
+    {
+        usedBeforeChunk += cursor - chunks[currentChunk].data;
+        currentChunk++;
+    }
+
+    /* Reuse a kept chunk if it's large enough. Otherwise insert a new one here */
+    if (currentChunk >= chunks.size() || chunks[currentChunk].size < minSize)
+    {
+        size_t size = max(CHUNK_SIZE, minSize);
+        chunks.insert(chunks.begin() + currentChunk, Chunk{new char[size], size});
+    }
+
+    cursor = chunks[currentChunk].data;
+    chunkEnd = cursor + chunks[currentChunk].size;
+}
+
+void BuildArena::reset()
+{
+    if (chunks.empty())
+        return;
+
+    currentChunk = 0;
+    cursor = chunks[0].data;
+    chunkEnd = cursor + chunks[0].size;
+    usedBeforeChunk = 0;
+}
+
+void BuildArena::release()
+{
+    for (auto &chunk : chunks)
+        delete[] chunk.data;
+
+    chunks.clear();
+    currentChunk = 0;
+    cursor = chunkEnd = NULL;
+    usedBeforeChunk = 0;
+}
+
+size_t BuildArena::getUsedBytes()
+{
+    return cursor == NULL ? 0 : usedBeforeChunk + (cursor - chunks[currentChunk].data);
+}
+
+size_t BuildArena::getPeakUsedBytes()
+{
+    return peakUsed;
+}
+
+size_t BuildArena::getCapacity()
+{
+    size_t capacity = 0;
+    for (auto &chunk : chunks)
+        capacity += chunk.size;
+
+    return capacity;
+}
+
+size_t BuildArena::getNumChunks()
+{
+    return chunks.size();
+}
@@ -0,0 +1,116 @@
+/**
+ * arena.h  //  Per-build memory arena.
+ *
+ * Parser records, field text and scratch buffers live only as long as a build,
+ * so they're bump-allocated from an arena instead of new/delete one by one.
+ * reset() rewinds the arena in O(1), keeping its chunks for reuse.
+ * Chunks are freed by release() or the destructor.
+ *
+ * An arena is NOT thread-safe. Give each thread its own.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "stdafx.hpp"
+
+using namespace std;
+
+class BuildArena
+{
+private:
+    struct Chunk
+    {
+        char *data;
+        size_t size;
+    };
+
+    vector<Chunk> chunks;       // All chunks, in use order
+    size_t currentChunk = 0;    // Index of the chunk being allocated from
+    char *cursor = NULL;        // Next free byte in current chunk
+    char *chunkEnd = NULL;      // End of current chunk
+    size_t usedBeforeChunk = 0; // Bytes used in chunks before current one
+    size_t peakUsed = 0;        // High-water mark of used bytes since construction
+
+    static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+public:
+    BuildArena() = default;
+    ~BuildArena();
+    BuildArena(const BuildArena &) = delete;
+    BuildArena &operator=(const BuildArena &) = delete;
+    BuildArena(BuildArena &&other) noexcept;
+
+    void *allocate(size_t size, size_t alignment = alignof(max_align_t)); // Allocate uninitialized memory
+    string_view copy(const char *text, size_t length);                    // Copy a string into arena (not '\0'-terminated)
+    string_view append(string_view string, const char *text, size_t length, char separator); // Append text (and a separator before it, if string is not empty).
+                                                                                             // Extends string in place if it's the last allocation.
+
+    void reset();   // Rewind in O(1). Everything allocated becomes invalid, chunks are kept
+    void release(); // Free all chunks
+
+    size_t getUsedBytes();     // Bytes used now
+    size_t getPeakUsedBytes(); // Most bytes ever used at a time
+    size_t getCapacity();      // Bytes held in chunks
+    size_t getNumChunks();
+
+private:
+    void useNextChunk(size_t minSize); // Move to the next chunk that can hold minSize bytes, allocating one if needed
+};
+
+/**
+ * Append-only list whose storage comes from a BuildArena.
+ * Items are never moved once added, and the list itself is freed with the arena.
+ */
+template <typename T>
+class ArenaList
+{
+private:
+    static const size_t ITEMS_PER_BLOCK = 128;
+
+    struct Block
+    {
+        T items[ITEMS_PER_BLOCK];
+        size_t count;
+        Block *next;
+    };
+
+    Block *head = NULL;
+    Block *tail = NULL;
+    size_t numItems = 0;
+
+public:
+    void push_back(BuildArena &arena, const T &item)
+    {
+        if (tail == NULL || tail->count == ITEMS_PER_BLOCK)
+        {
+            Block *block = new (arena.allocate(sizeof(Block), alignof(Block))) Block();
+            block->count = 0;
+            block->next = NULL;
+
+            if (tail == NULL)
+                head = block;
+            else
+                tail->next = block;
+            tail = block;
+        }
+
+        tail->items[tail->count++] = item;
+        numItems++;
+    }
+
+    size_t size() const
+    {
+        return numItems;
+    }
+
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        for (Block *block = head; block != NULL; block = block->next)
+            for (size_t i = 0; i < block->count; i++)
+                func(block->items[i]);
+    }
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "catalog_cache.h"
+
+static const char CACHE_MAGIC[8] = {'C', 'P', 'M', 'C', 'A', 'T', '1', '\0'};
+
+CatalogCache::CatalogCache()
+{
+}
+
+CatalogCache::~CatalogCache()
+{
+    close();
+}
+
+int CatalogCache::write(const char *cache_fileName, const DependencyGraph &graph, const vector<PackageRecord> &packageRecords)
+{
+    uint32_t n = graph.getNumNodes();
+    if (packageRecords.size() != n)
+        return CPM_UNEXPECTED_ERROR;
+
+    /**
+     * String pool. Equal strings (versions, categories...) are stored once
+     */
+    string pool;
+    unordered_map<string, StringRef> interned;
+
+    auto addString = [&](string_view text) -> StringRef {
+        auto added = interned.emplace(string(text), StringRef{(uint32_t)pool.length(), (uint32_t)text.length()});
+        if (added.second)
+            pool.append(text.data(), text.length());
+        return added.first->second;
+    };
+
+    /**
+     * Name table, records & dependencies
+     */
+    FileHeader header = {};
+    vector<StringRef> name_table(n);
+    vector<Record> record_table(n);
+    vector<uint32_t> dependency_offsets(n + 1, 0);
+    vector<uint32_t> dependency_list;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const PackageRecord &source = packageRecords[i];
+        Record &record = record_table[i];
+
+        record = Record();
+        record.install_size = record.source_size = -1;
+        name_table[i] = addString(graph.getName(i));
+
+        if (source.found)
+        {
+            record.is_package = 1;
+            record.version = addString(source.version);
+            record.sdesc = addString(source.sdesc);
+            record.category = addString(source.category);
+            record.install_path = addString(source.install.path);
+            record.install_sha512 = addString(source.install.sha512);
+            record.install_size = source.install.size;
+            record.source_path = addString(source.source.path);
+            record.source_sha512 = addString(source.source.sha512);
+            record.source_size = source.source.size;
+            header.num_packages++;
+        }
+
+        dependency_offsets[i] = dependency_list.size();
+        for (uint32_t dependency : graph.getDependencies(i))
+            dependency_list.push_back(dependency);
+    }
+    dependency_offsets[n] = dependency_list.size();
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.stamp = graph.getStamp();
+    header.num_names = n;
+    header.num_dependencies = dependency_list.size();
+    header.string_pool_size = pool.length();
+
+    /**
+     * Write to a temporary file first, so a reader never sees a partial cache
+     */
+    string tmp_fileName = string(cache_fileName) + ".tmp";
+    FILE *out = fopen(tmp_fileName.c_str(), "wb");
+    if (out == NULL)
+    {
+        cerr << "Error while saving catalog cache: Cannot write " << tmp_fileName << endl;
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(name_table.data(), sizeof(StringRef), n, out) == n &&
+              fwrite(record_table.data(), sizeof(Record), n, out) == n &&
+              fwrite(dependency_offsets.data(), sizeof(uint32_t), n + 1, out) == n + 1 &&
+              fwrite(dependency_list.data(), sizeof(uint32_t), dependency_list.size(), out) == dependency_list.size() &&
+              fwrite(pool.data(), 1, pool.length(), out) == pool.length();
+    ok = fclose(out) == 0 && ok;
+
+    if (!ok || rename(tmp_fileName.c_str(), cache_fileName) != 0)
+    {
+        cerr << "Error while saving catalog cache: Cannot write " << cache_fileName << endl;
+        remove(tmp_fileName.c_str());
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    return CPM_OK;
+}
+
+int CatalogCache::open(const char *cache_fileName, uint64_t expectedStamp)
+{
+    close();
+
+    int rc = mapFileForScan(cache_fileName, cacheFile);
+    if (rc != CPM_OK)
+        return rc;
+
+    /**
+     * Validate cache
+     */
+    const FileHeader *file_header = (const FileHeader *)cacheFile.data;
+    if (cacheFile.size < sizeof(FileHeader) || memcmp(file_header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        cacheFile.size != sizeof(FileHeader) + (size_t)file_header->num_names * (sizeof(StringRef) + sizeof(Record)) +
+                              ((size_t)file_header->num_names + 1 + file_header->num_dependencies) * sizeof(uint32_t) + file_header->string_pool_size)
+    {
+        cerr << "Broken catalog cache: " << cache_fileName << endl;
+        close();
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    if (file_header->stamp != expectedStamp)
+    {
+        close();
+        return CPM_INDEX_OUTDATED;
+    }
+
+    header = file_header;
+    names = (const StringRef *)(cacheFile.data + sizeof(FileHeader));
+    records = (const Record *)(names + header->num_names);
+    dependencyOffsets = (const uint32_t *)(records + header->num_names);
+    dependencies = dependencyOffsets + header->num_names + 1;
+    strings = (const char *)(dependencies + header->num_dependencies);
+
+    if (!isValid())
+    {
+        cerr << "Broken catalog cache: " << cache_fileName << endl;
+        close();
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    return CPM_OK;
+}
+
+int CatalogCache::open(const char *cache_fileName, const char *setupini_fileName)
+{
+    SetupIniHeader setupini_header;
+
+    int rc = readSetupIniHeader(setupini_fileName, setupini_header);
+    if (rc != CPM_OK)
+        return rc;
+
+    return open(cache_fileName, setupini_header.getStamp());
+}
+
+void CatalogCache::close()
+{
+    if (cacheFile.data != NULL)
+        unmapFile(cacheFile);
+
+    header = NULL;
+    names = NULL;
+    records = NULL;
+    dependencyOffsets = dependencies = NULL;
+    strings = NULL;
+}
+
+bool CatalogCache::isValid() const
+{
+    auto isValidString = [&](StringRef ref) {
+        return (uint64_t)ref.offset + ref.length <= header->string_pool_size;
+    };
+
+    for (uint32_t i = 0; i < header->num_names; i++)
+    {
+        const Record &record = records[i];
+        if (!isValidString(names[i]) || !isValidString(record.version) || !isValidString(record.sdesc) ||
+            !isValidString(record.category) || !isValidString(record.install_path) || !isValidString(record.install_sha512) ||
+            !isValidString(record.source_path) || !isValidString(record.source_sha512) ||
+            dependencyOffsets[i] > dependencyOffsets[i + 1])
+            return false;
+    }
+
+    if (dependencyOffsets[header->num_names] != header->num_dependencies)
+        return false;
+
+    for (uint32_t i = 0; i < header->num_dependencies; i++)
+    {
+        if (dependencies[i] >= header->num_names)
+            return false;
+    }
+
+    return true;
+}
+
+string_view CatalogCache::getString(StringRef ref) const
+{
+    return string_view(strings + ref.offset, ref.length);
+}
+
+uint32_t CatalogCache::find(string_view name) const
+{
+    uint32_t low = 0, high = getNumNames();
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if (getString(names[mid]) < name)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low < getNumNames() && getString(names[low]) == name ? low : NO_NAME;
+}
+
+bool CatalogCache::lookup(string_view pkg_name, Package &pkg) const
+{
+    uint32_t name = find(pkg_name);
+    if (name == NO_NAME || !records[name].is_package)
+        return false;
+
+    const Record &record = records[name];
+
+    pkg.name = getString(names[name]);
+    pkg.version = getString(record.version);
+    pkg.sdesc = getString(record.sdesc);
+    pkg.category = getString(record.category);
+    pkg.install.path = getString(record.install_path);
+    pkg.install.size = record.install_size;
+    pkg.install.sha512 = getString(record.install_sha512);
+    pkg.source.path = getString(record.source_path);
+    pkg.source.size = record.source_size;
+    pkg.source.sha512 = getString(record.source_sha512);
+
+    return true;
+}
+
+string_view CatalogCache::getName(uint32_t name) const
+{
+    return getString(names[name]);
+}
+
+bool CatalogCache::isPackage(uint32_t name) const
+{
+    return records[name].is_package != 0;
+}
+
+DependencyGraph::EdgeRange CatalogCache::getDependencies(uint32_t name) const
+{
+    return {dependencies + dependencyOffsets[name], dependencies + dependencyOffsets[name + 1]};
+}
+
+uint32_t CatalogCache::getNumNames() const
+{
+    return header != NULL ? header->num_names : 0;
+}
+
+uint32_t CatalogCache::getNumPackages() const
+{
+    return header != NULL ? header->num_packages : 0;
+}
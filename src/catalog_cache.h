@@ -0,0 +1,112 @@
+/**
+ * catalog_cache.h  //  Compiled catalog cache, for lookups without SQLite.
+ *
+ * A single file holding what most commands need of each package's current version: version,
+ * sdesc, category, install/source package files, and dependencies. Like the dependency graph,
+ * it's laid out as arrays, so opening it is mapping it, and a lookup is a binary search:
+ * name table [n] (sorted), records [n], dependency offsets [n + 1], dependencies [e], then a string pool.
+ * Names include dependencies not in setup.ini, which have no package.
+ *
+ * The cache is written by CygpmDatabase (see saveCatalogCache()) and records the stamp of setup.ini's
+ * header, so it refuses to answer for any other setup.ini. It's a local cache in native byte order.
+ */
+
+#ifndef CATALOG_CACHE_H
+#define CATALOG_CACHE_H
+
+#include "database.h"
+
+using namespace std;
+
+class CatalogCache
+{
+public:
+    static const uint32_t NO_NAME = UINT32_MAX;
+
+    /**
+     * A package's current version. Views point into the mapped cache, valid until close()
+     */
+    struct Package
+    {
+        struct Pak
+        {
+            string_view path;
+            int64_t size = -1; // -1 if unknown
+            string_view sha512; // Hex digest
+        };
+
+        string_view name;
+        string_view version;
+        string_view sdesc;
+        string_view category;
+        Pak install;
+        Pak source;
+    };
+
+private:
+    struct StringRef
+    {
+        uint32_t offset; // In string pool
+        uint32_t length;
+    };
+
+    struct FileHeader
+    {
+        char magic[8];   // CACHE_MAGIC
+        uint64_t stamp;  // Stamp of setup.ini's header, see SetupIniHeader::getStamp()
+        uint32_t num_names;
+        uint32_t num_packages;
+        uint32_t num_dependencies;
+        uint32_t string_pool_size;
+    };
+
+    struct Record
+    {
+        StringRef version; // Empty for names without package
+        StringRef sdesc;
+        StringRef category;
+        StringRef install_path;
+        StringRef install_sha512;
+        StringRef source_path;
+        StringRef source_sha512;
+        int64_t install_size; // -1 if unknown
+        int64_t source_size;
+        uint32_t is_package;  // 0 if it's only depended on
+        uint32_t reserved;    // Always 0
+    };
+
+    MappedFile cacheFile;
+    const FileHeader *header = NULL;
+    const StringRef *names = NULL;
+    const Record *records = NULL;
+    const uint32_t *dependencyOffsets = NULL;
+    const uint32_t *dependencies = NULL;
+    const char *strings = NULL;
+
+public:
+    CatalogCache();
+    ~CatalogCache();
+    CatalogCache(const CatalogCache &) = delete;
+    CatalogCache &operator=(const CatalogCache &) = delete;
+
+    static int write(const char *cache_fileName, const DependencyGraph &graph, const vector<PackageRecord> &records); // Records are of graph's nodes, in node order
+
+    int open(const char *cache_fileName, uint64_t expectedStamp);          // Map a cache. CPM_INDEX_OUTDATED if it's built from another catalog
+    int open(const char *cache_fileName, const char *setupini_fileName); // Ditto, checking against setup.ini's header
+    void close();
+
+    bool lookup(string_view pkg_name, Package &pkg) const; // false if there's no such package
+    uint32_t find(string_view name) const;                 // Binary search among all names. NO_NAME if not found
+    string_view getName(uint32_t name) const;
+    bool isPackage(uint32_t name) const;                   // false if name is only depended on
+    DependencyGraph::EdgeRange getDependencies(uint32_t name) const; // Of current version, as names, in setup.ini order
+
+    uint32_t getNumNames() const;
+    uint32_t getNumPackages() const;
+
+private:
+    bool isValid() const; // Every string, offset & dependency stays within its array
+    string_view getString(StringRef ref) const;
+};
+
+#endif
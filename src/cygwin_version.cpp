@@ -0,0 +1,178 @@
+#include "cygwin_version.h"
+
+/**
+ * Segment types, in sort order. Also the tag bytes of keys
+ */
+enum SegmentType
+{
+    SEGMENT_TILDE = 0, // "~", older than anything
+    SEGMENT_END,       // No segment left
+    SEGMENT_ALPHA,
+    SEGMENT_NUMBER
+};
+
+struct Segment
+{
+    SegmentType type;
+    string_view text; // Letters, or digits without leading zeros
+};
+
+struct VersionParts
+{
+    string_view epoch; // Digits. Empty if there's no epoch, which means 0
+    string_view upstream;
+    string_view release;
+};
+
+/**
+ * ASCII only, whatever the locale is
+ */
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isAlpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static string_view stripLeadingZeros(string_view digits)
+{
+    size_t first = digits.find_first_not_of('0');
+    return first == string_view::npos ? string_view() : digits.substr(first);
+}
+
+static VersionParts splitVersion(string_view version)
+{
+    VersionParts parts;
+
+    size_t colon = version.find(':');
+    if (colon != string_view::npos && colon > 0 && all_of(version.begin(), version.begin() + colon, isDigit))
+    {
+        parts.epoch = stripLeadingZeros(version.substr(0, colon));
+        version.remove_prefix(colon + 1);
+    }
+
+    size_t dash = version.rfind('-');
+    parts.upstream = version.substr(0, dash);
+    if (dash != string_view::npos)
+        parts.release = version.substr(dash + 1);
+
+    return parts;
+}
+
+/**
+ * Take the next segment off the front of rest, skipping separators before it
+ */
+static Segment nextSegment(string_view &rest)
+{
+    size_t start = 0;
+    while (start < rest.length() && !isDigit(rest[start]) && !isAlpha(rest[start]) && rest[start] != '~')
+        start++;
+    rest.remove_prefix(start);
+
+    if (rest.empty())
+        return {SEGMENT_END, string_view()};
+
+    if (rest[0] == '~')
+    {
+        rest.remove_prefix(1);
+        return {SEGMENT_TILDE, string_view()};
+    }
+
+    bool is_number = isDigit(rest[0]);
+    size_t end = 1;
+    while (end < rest.length() && (is_number ? isDigit(rest[end]) : isAlpha(rest[end])))
+        end++;
+
+    string_view text = rest.substr(0, end);
+    rest.remove_prefix(end);
+
+    if (is_number)
+        return {SEGMENT_NUMBER, stripLeadingZeros(text)};
+    return {SEGMENT_ALPHA, text};
+}
+
+static int compareNumbers(string_view a, string_view b) // Digits without leading zeros
+{
+    if (a.length() != b.length())
+        return a.length() < b.length() ? -1 : 1;
+
+    int result = a.compare(b);
+    return result < 0 ? -1 : (result > 0 ? 1 : 0);
+}
+
+static int compareSegments(string_view a, string_view b)
+{
+    while (true)
+    {
+        Segment x = nextSegment(a);
+        Segment y = nextSegment(b);
+
+        if (x.type != y.type)
+            return x.type < y.type ? -1 : 1;
+        if (x.type == SEGMENT_END)
+            return 0;
+
+        int result = x.type == SEGMENT_NUMBER ? compareNumbers(x.text, y.text) : x.text.compare(y.text);
+        if (result != 0)
+            return result < 0 ? -1 : 1;
+    }
+}
+
+int compareVersions(string_view a, string_view b)
+{
+    VersionParts x = splitVersion(a);
+    VersionParts y = splitVersion(b);
+
+    int result = compareNumbers(x.epoch, y.epoch);
+    if (result == 0)
+        result = compareSegments(x.upstream, y.upstream);
+    if (result == 0)
+        result = compareSegments(x.release, y.release);
+
+    return result;
+}
+
+/**
+ * Key layout: epoch as a number, then segments of upstream & release, each part closed by SEGMENT_END.
+ * A segment is its type byte, followed by
+ * - a number: its digit count (one byte), then the digits. More digits sort after fewer;
+ * - letters: themselves, then '\0', so a prefix sorts first.
+ */
+static void appendNumber(string &key, string_view digits)
+{
+    digits = digits.substr(0, UINT8_MAX);
+    key += (char)(uint8_t)digits.length();
+    key.append(digits.data(), digits.length());
+}
+
+static void appendSegments(string &key, string_view part)
+{
+    while (true)
+    {
+        Segment segment = nextSegment(part);
+        key += (char)segment.type;
+
+        if (segment.type == SEGMENT_END)
+            return;
+        if (segment.type == SEGMENT_NUMBER)
+            appendNumber(key, segment.text);
+        else if (segment.type == SEGMENT_ALPHA)
+        {
+            key.append(segment.text.data(), segment.text.length());
+            key += '\0';
+        }
+    }
+}
+
+void makeVersionKey(string_view version, string &key)
+{
+    VersionParts parts = splitVersion(version);
+
+    key.clear();
+    appendNumber(key, parts.epoch);
+    appendSegments(key, parts.upstream);
+    appendSegments(key, parts.release);
+}
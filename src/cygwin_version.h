@@ -0,0 +1,26 @@
+/**
+ * cygwin_version.h  //  Compare Cygwin package versions.
+ *
+ * A version is "[epoch:]upstream-release", e.g. 4.4.12-3. Epoch is compared as a number,
+ * then upstream, then release, each one segment by segment as RPM (and Setup, via libsolv) does:
+ * Runs of digits compare as numbers, runs of letters as strings, a number is newer than letters,
+ * other characters only separate segments, and "~" sorts before anything, even the end
+ * (so 1.0~rc1 < 1.0). The side having segments left over is newer.
+ *
+ * compareVersions() works on the strings in place, allocating nothing. makeVersionKey() turns a
+ * version into a key whose byte order (memcmp(), or SQLite's BLOB order) is the same, so versions
+ * can be stored, indexed & sorted by key without the comparator.
+ */
+
+#ifndef CYGWIN_VERSION_H
+#define CYGWIN_VERSION_H
+
+#include "stdafx.hpp"
+
+using namespace std;
+
+int compareVersions(string_view a, string_view b);     // < 0, 0 or > 0, as a is older than, equal to or newer than b
+void makeVersionKey(string_view version, string &key); // Replace key's content with version's sortable key. Reuses key's buffer.
+                                                       // Numbers longer than 255 digits aren't told apart
+
+#endif
@@ -1,4 +1,5 @@
 #include "database.h"
+#include "catalog_cache.h"
 
 static int callback(void *NotUsed, int argc, char **argv, char **azColName)
 {
@@ -11,17 +12,263 @@ static int callback(void *NotUsed, int argc, char **argv, char **azColName)
     return 0;
 }
 
-CygpmDatabase::CygpmDatabase(const char *fileName)
+/**
+ * PRAGMAs of database profiles, indexed by DatabaseProfile.
+ * Both stay in WAL mode: Leaving it needs the file to ourselves, and would block readers while building.
+ */
+static const char *PROFILE_SQL[] = {
+    /* DB_PROFILE_SERVING: SQLite's defaults, but in WAL mode, where synchronous = NORMAL is still safe */ R"(
+        PRAGMA journal_mode = WAL;
+        PRAGMA synchronous = NORMAL;
+        PRAGMA cache_size = -2000;
+        PRAGMA temp_store = DEFAULT;
+    )",
+    /* DB_PROFILE_BULK_BUILD: Everything is rebuilt from setup.ini, so durability matters less than speed */ R"(
+        PRAGMA journal_mode = WAL;
+        PRAGMA synchronous = OFF;
+        PRAGMA cache_size = -65536;
+        PRAGMA temp_store = MEMORY;
+    )",
+};
+static const char *PROFILE_NAMES[] = {"serving", "bulk build"};
+
+/**
+ * PRAGMAs of read-only connections. Pages are read through a shared memory mapping instead of being copied
+ * into each process's page cache.
+ */
+static const char *READ_ONLY_SQL = R"(
+    PRAGMA query_only = 1;
+    PRAGMA mmap_size = 268435456;
+)";
+
+static const int BUSY_TIMEOUT_MS = 5000; // Wait this long for another process's lock, instead of failing at once
+
+/**
+ * SQL of registered statements, indexed by StatementId.
+ * Queries return sizes & digests as text, the same as they are in setup.ini.
+ */
+static const char *STATEMENT_SQL[] = {
+    /* STMT_INSERT_NAME */ R"(INSERT OR IGNORE INTO "PACKAGE_NAMES" (NAME) VALUES (:name);)",
+    /* STMT_GET_NAME_ID */ R"(SELECT ID FROM "PACKAGE_NAMES" WHERE NAME = :name;)",
+    /* STMT_INSERT_PACKAGE_INFO */ R"(
+        INSERT INTO "PACKAGES" (ID, SDESC, LDESC, CATEGORY, OBSOLETES__RAW, PROVIDES__RAW, CONFLICTS__RAW, BLOCK_HASH)
+        VALUES (:package_id, :sdesc, :ldesc, :category, :obsoletes__raw, :provides__raw, :conflicts__raw, :block_hash);
+    )",
+    /* STMT_INSERT_VERSION */ R"(
+        INSERT INTO "VERSIONS" (PACKAGE_ID, VERSION, VERSION_KEY, IS_CURRENT, REQUIRES__RAW, DEPENDS2__RAW,
+                                INSTALL_PAK_PATH, INSTALL_PAK_SIZE, INSTALL_PAK_SHA512,
+                                SOURCE_PAK_PATH, SOURCE_PAK_SIZE, SOURCE_PAK_SHA512)
+        VALUES (:package_id, :version, :version_key, :is_current, :requires__raw, :depends2__raw,
+                :install_pak_path, :install_pak_size, :install_pak_sha512,
+                :source_pak_path, :source_pak_size, :source_pak_sha512);
+    )",
+    /* STMT_INSERT_DEPENDENCY */ R"(
+        INSERT INTO "DEPENDENCIES" (VERSION_ID, DEPENDS_ON) VALUES (:version_id, :depends_on);
+    )",
+    /* STMT_DELETE_PACKAGE_INFO */ R"(DELETE FROM "PACKAGES" WHERE ID = :package_id;)",
+    /* STMT_DELETE_VERSIONS */ R"(DELETE FROM "VERSIONS" WHERE PACKAGE_ID = :package_id;)",
+    /* STMT_DELETE_DEPENDENCIES */ R"(
+        DELETE FROM "DEPENDENCIES" WHERE VERSION_ID IN (SELECT ID FROM "VERSIONS" WHERE PACKAGE_ID = :package_id);
+    )",
+    /* STMT_REPLACE_METADATA */ R"(
+        INSERT OR REPLACE INTO "METADATA" (KEY, VALUE) VALUES (:key, :value);
+    )",
+    /* STMT_GET_PACKAGE */ R"(
+        SELECT V.VERSION, P.SDESC, P.LDESC, P.CATEGORY,
+               V.INSTALL_PAK_PATH, IFNULL(V.INSTALL_PAK_SIZE, ''),
+               CASE typeof(V.INSTALL_PAK_SHA512) WHEN 'blob' THEN lower(hex(V.INSTALL_PAK_SHA512)) ELSE IFNULL(V.INSTALL_PAK_SHA512, '') END,
+               V.SOURCE_PAK_PATH, IFNULL(V.SOURCE_PAK_SIZE, ''),
+               CASE typeof(V.SOURCE_PAK_SHA512) WHEN 'blob' THEN lower(hex(V.SOURCE_PAK_SHA512)) ELSE IFNULL(V.SOURCE_PAK_SHA512, '') END
+        FROM "PACKAGE_NAMES" N
+            JOIN "PACKAGES" P ON P.ID = N.ID
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID AND V.IS_CURRENT = 1
+        WHERE N.NAME = :pkg_name
+        ORDER BY V.ID LIMIT 1; -- A version listed twice in setup.ini: The first one
+    )",
+    /* STMT_GET_PREV_VERSION */ R"(
+        SELECT V.VERSION, NULL, NULL, NULL,
+               V.INSTALL_PAK_PATH, IFNULL(V.INSTALL_PAK_SIZE, ''),
+               CASE typeof(V.INSTALL_PAK_SHA512) WHEN 'blob' THEN lower(hex(V.INSTALL_PAK_SHA512)) ELSE IFNULL(V.INSTALL_PAK_SHA512, '') END,
+               V.SOURCE_PAK_PATH, IFNULL(V.SOURCE_PAK_SIZE, ''),
+               CASE typeof(V.SOURCE_PAK_SHA512) WHEN 'blob' THEN lower(hex(V.SOURCE_PAK_SHA512)) ELSE IFNULL(V.SOURCE_PAK_SHA512, '') END
+        FROM "PACKAGE_NAMES" N
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID AND V.IS_CURRENT = 0
+        WHERE N.NAME = :pkg_name AND V.VERSION = :version ORDER BY V.ID LIMIT 1;
+    )",
+    /* STMT_GET_PREV_VERSIONS */ R"(
+        SELECT V.VERSION
+        FROM "PACKAGE_NAMES" N
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID AND V.IS_CURRENT = 0
+        WHERE N.NAME = :pkg_name ORDER BY V.VERSION_KEY;
+    )",
+    /* STMT_GET_NEWEST_VERSION */ R"(
+        SELECT V.VERSION
+        FROM "PACKAGE_NAMES" N
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID
+        WHERE N.NAME = :pkg_name ORDER BY V.VERSION_KEY DESC LIMIT 1;
+    )",
+    /* STMT_GET_VERSIONS_IN_RANGE */ R"(
+        SELECT V.VERSION
+        FROM "PACKAGE_NAMES" N
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID
+        WHERE N.NAME = :pkg_name AND V.VERSION_KEY BETWEEN :min_key AND :max_key ORDER BY V.VERSION_KEY;
+    )",
+    /* STMT_GET_DEPENDENCIES */ R"(
+        SELECT DN.NAME, DN.ID
+        FROM "PACKAGE_NAMES" N
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID
+            JOIN "DEPENDENCIES" D ON D.VERSION_ID = V.ID
+            JOIN "PACKAGE_NAMES" DN ON DN.ID = D.DEPENDS_ON
+        WHERE N.NAME = :pkg_name AND V.VERSION = :version ORDER BY D.rowid;
+    )",
+    /* STMT_GET_CURRENT_DEPENDENCIES */ R"(
+        SELECT DN.NAME, DN.ID
+        FROM "PACKAGE_NAMES" N
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID AND V.IS_CURRENT = 1
+            JOIN "DEPENDENCIES" D ON D.VERSION_ID = V.ID
+            JOIN "PACKAGE_NAMES" DN ON DN.ID = D.DEPENDS_ON
+        WHERE N.NAME = :pkg_name ORDER BY D.rowid;
+    )",
+    /* STMT_GET_DEPENDENCIES_BY_ID */ R"(
+        SELECT DN.NAME, DN.ID
+        FROM "VERSIONS" V
+            JOIN "DEPENDENCIES" D ON D.VERSION_ID = V.ID
+            JOIN "PACKAGE_NAMES" DN ON DN.ID = D.DEPENDS_ON
+        WHERE V.PACKAGE_ID = :package_id AND V.IS_CURRENT = 1 ORDER BY D.rowid;
+    )",
+    /* STMT_RESOLVE_DEPENDENCIES */ R"(
+        WITH RECURSIVE
+            ROOT(ID) AS (
+                SELECT ID FROM "PACKAGE_NAMES" WHERE NAME = :pkg_name
+            ),
+            LISTED(ID) AS (
+                SELECT N.ID
+                FROM json_each(:listed) R -- Packages already listed, as a JSON array. They're not expanded
+                    CROSS JOIN "PACKAGE_NAMES" N ON N.NAME = R.value
+            ),
+            CLOSURE(ID) AS (
+                SELECT ID FROM ROOT
+                UNION
+                SELECT D.DEPENDS_ON
+                FROM CLOSURE C
+                    JOIN "VERSIONS" V ON V.PACKAGE_ID = C.ID
+                    JOIN "DEPENDENCIES" D ON D.VERSION_ID = V.ID
+                WHERE CASE WHEN :version IS NOT NULL AND C.ID = (SELECT ID FROM ROOT)
+                           THEN V.VERSION = :version
+                           ELSE V.IS_CURRENT = 1 END
+                    AND D.DEPENDS_ON NOT IN LISTED
+            )
+        SELECT CASE WHEN C.ID = (SELECT ID FROM ROOT) THEN 0 ELSE C.ID END, DN.ID, DN.NAME
+        FROM CLOSURE C
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = C.ID
+            JOIN "DEPENDENCIES" D ON D.VERSION_ID = V.ID
+            JOIN "PACKAGE_NAMES" DN ON DN.ID = D.DEPENDS_ON
+        WHERE CASE WHEN :version IS NOT NULL AND C.ID = (SELECT ID FROM ROOT)
+                   THEN V.VERSION = :version
+                   ELSE V.IS_CURRENT = 1 END
+        ORDER BY D.rowid; -- Each package's dependencies in setup.ini order, as STMT_GET_*DEPENDENCIES* return them
+    )",
+    /* STMT_RESOLVE_DEPENDENTS */ R"(
+        WITH RECURSIVE
+            CLOSURE(ID) AS (
+                SELECT ID FROM "PACKAGE_NAMES" WHERE NAME = :pkg_name
+                UNION
+                SELECT V.PACKAGE_ID
+                FROM CLOSURE C
+                    JOIN "DEPENDENCIES" D ON D.DEPENDS_ON = C.ID -- Uses IDX_DEPENDENCIES_DEPENDS_ON
+                    JOIN "VERSIONS" V ON V.ID = D.VERSION_ID AND V.IS_CURRENT = 1
+            )
+        SELECT N.NAME FROM CLOSURE C CROSS JOIN "PACKAGE_NAMES" N ON N.ID = C.ID;
+    )",
+    /* STMT_FIND_ORPHANS */ R"(
+        WITH RECURSIVE
+            INSTALLED(ID, USER_PICKED) AS (
+                SELECT N.ID, json_extract(R.value, '$[1]')
+                FROM json_each(:installed) R -- Installed packages, as a JSON array of [name, user_picked]
+                    CROSS JOIN "PACKAGE_NAMES" N ON N.NAME = json_extract(R.value, '$[0]')
+            ),
+            NEEDED(ID) AS (
+                SELECT ID FROM INSTALLED WHERE USER_PICKED
+                UNION
+                SELECT D.DEPENDS_ON
+                FROM NEEDED C
+                    JOIN "VERSIONS" V ON V.PACKAGE_ID = C.ID AND V.IS_CURRENT = 1
+                    JOIN "DEPENDENCIES" D ON D.VERSION_ID = V.ID
+            )
+        SELECT DISTINCT N.NAME
+        FROM INSTALLED I CROSS JOIN "PACKAGE_NAMES" N ON N.ID = I.ID
+        WHERE NOT I.USER_PICKED AND I.ID NOT IN NEEDED
+        ORDER BY N.NAME;
+    )",
+    /* STMT_GET_PACKAGE_RECORDS */ R"(
+        SELECT R.key, V.VERSION, P.SDESC, P.LDESC, P.CATEGORY,
+               V.INSTALL_PAK_PATH, V.INSTALL_PAK_SIZE, V.INSTALL_PAK_SHA512,
+               V.SOURCE_PAK_PATH, V.SOURCE_PAK_SIZE, V.SOURCE_PAK_SHA512
+        FROM json_each(:pkg_names) R -- Requested names, as a JSON array. key is the position
+            CROSS JOIN "PACKAGE_NAMES" N ON N.NAME = R.value
+            JOIN "PACKAGES" P ON P.ID = N.ID
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID
+        WHERE CASE WHEN :version IS NULL THEN V.IS_CURRENT = 1
+                   ELSE V.VERSION = :version END -- Current or previous
+        ORDER BY R.key, V.ID;
+    )",
+    /* STMT_SEARCH_PACKAGES */ R"(
+        SELECT NAME, SDESC, snippet("PACKAGE_SEARCH", -1, '[', ']', '...', 12), bm25("PACKAGE_SEARCH", 10.0, 4.0, 1.0) AS RANK
+        FROM "PACKAGE_SEARCH" WHERE "PACKAGE_SEARCH" MATCH :query
+        ORDER BY RANK LIMIT :limit; -- Weights: a hit in NAME counts most
+    )",
+    /* STMT_SEARCH_TRIGRAMS */ R"(
+        SELECT NAME, SDESC, LDESC FROM "PACKAGE_TRIGRAMS"
+        WHERE NAME LIKE :pattern OR SDESC LIKE :pattern OR LDESC LIKE :pattern -- Each is a trigram lookup
+        ORDER BY NAME;
+    )",
+    /* STMT_COUNT_PACKAGES */ R"(
+        SELECT COUNT(*) FROM "PACKAGES";
+    )",
+};
+static_assert(sizeof(STATEMENT_SQL) / sizeof(STATEMENT_SQL[0]) == NUM_STATEMENTS, "Every StatementId needs its SQL");
+
+CygpmDatabase::CygpmDatabase(const char *fileName, DatabaseOpenMode mode)
 {
-    open(fileName);
+    open(fileName, mode);
 }
 
-void CygpmDatabase::open(const char *fileName)
+void CygpmDatabase::open(const char *fileName, DatabaseOpenMode mode)
 {
     /**
      * Open database
+     * Each CygpmDatabase owns its connection and is used by one thread at a time,
+     * so SQLite's per-connection mutex is not needed. Different objects (connections)
+     * can still be used on different threads simultaneously.
      */
-    rc = sqlite3_open(fileName, &db);
+    if (!sqlite3_threadsafe())
+        cerr << "Warning: SQLite is built without thread safety, don't use multiple databases concurrently" << endl;
+
+    openMode = mode;
+
+    if (mode == DB_OPEN_READ_WRITE)
+        rc = sqlite3_open_v2(fileName, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL);
+    else if (mode == DB_OPEN_READ_ONLY)
+        rc = sqlite3_open_v2(fileName, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+    else
+    {
+        // immutable=1 is only accepted in a URI. Escape characters having meanings there
+        string uri = "file:";
+        for (const char *p = fileName; *p != '\0'; p++)
+        {
+            if (*p == '%' || *p == '?' || *p == '#')
+            {
+                char escaped[4];
+                snprintf(escaped, sizeof(escaped), "%%%02X", (unsigned char)*p);
+                uri += escaped;
+            }
+            else
+                uri += *p;
+        }
+        uri += "?immutable=1";
+
+        rc = sqlite3_open_v2(uri.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_URI, NULL);
+    }
 
     if (rc)
     {
@@ -31,124 +278,105 @@ void CygpmDatabase::open(const char *fileName)
     }
     else
     {
-        cerr << "Opened database successfully" << endl;
+        cerr << "Opened database successfully" << (mode == DB_OPEN_READ_WRITE ? "" : " (read-only)") << endl;
     }
 
-    /**
-     * Optimize database - Store journal in memory
-     */
-#if 0
-    const char *SQL_PRAGMA_SET_JOURNAL_TO_MEMORY = R"(
-        PRAGMA journal_mode = memory;
-    )";
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    registerVersionFunctions();
 
-    rc = sqlite3_exec(db, SQL_PRAGMA_SET_JOURNAL_TO_MEMORY, NULL, NULL, &zErrMsg);
-    if (rc != SQLITE_OK)
-    {
-        cerr << "Failed to set journal to memory: " << zErrMsg << endl;
-        errorLevel = sqlite3_errcode(db);
-    }
-    else
+    if (mode != DB_OPEN_READ_WRITE)
     {
-        cerr << "Database: Journal set to memory" << endl;
+        sqlite3_exec(db, READ_ONLY_SQL, NULL, 0, NULL);
+
+        // Nothing can be converted in place. Queries need the current tables
+        if (!hasCurrentSchema())
+        {
+            cerr << "Can't open database read-only: It's not built by this version. Open it for writing once to convert it" << endl;
+            errorLevel = SQLITE_READONLY;
+            return;
+        }
+
+        errorLevel = 0;
+        return;
     }
-#endif
+
+    // A new database gets larger pages, which suit bulk builds. It must be set before entering WAL mode
+    sqlite3_exec(db, "PRAGMA page_size = 16384;", NULL, 0, NULL);
+
+    // For faster builds, see applyProfile()
+    sqlite3_exec(db, PROFILE_SQL[DB_PROFILE_SERVING], NULL, 0, NULL);
+
+    // Databases built by older versions are converted in place
+    migrateSchema();
+
     // Constructor doesn't support return values. So use errorLevel instead.
     errorLevel = 0;
 }
 
 CygpmDatabase::~CygpmDatabase()
 {
+    // Tables created for a full rebuild which never came. Keep them, as if they were committed at once
+    if (fullRebuild)
+        commitTransaction();
+
+    for (auto stmt : statements)
+        sqlite3_finalize(stmt);
     sqlite3_close(db);
 }
 
-int CygpmDatabase::createTable()
+int CygpmDatabase::parseAndBuildDatabase(const char *setupini_fileName)
 {
-    /** 
-     * Initialize transaction
-     */
-    initTransaction();
-    if (errorLevel != 0)
+    int result;
+
+    auto time_start = chrono::steady_clock::now();
+
+    ParseMode mode = parseMode;
+    if (incrementalBuild && mode == PARSE_MODE_STREAM)
     {
-        cerr << "Error while creating tables: Transaction starting failed" << endl;
-        return errorLevel;
+        cerr << "> Incremental build needs raw package blocks, switching to mapped parsing" << endl;
+        mode = PARSE_MODE_MMAP;
     }
 
-    /** 
-     * Create package info table
-     */
-    const char *SQL_CREATE_PACKAGE_INFO = R"(
-        DROP TABLE IF EXISTS "PKG_INFO";
-
-        CREATE TABLE IF NOT EXISTS "PKG_INFO" (
-            "PKG_NAME"	TEXT NOT NULL,
-            "SDESC"	TEXT,
-            "LDESC"	TEXT,
-            "CATEGORY"	TEXT,
-            "REQUIRES__RAW"	TEXT,
-            "VERSION"	TEXT,
-            "INSTALL_PAK_PATH"	TEXT,
-            "INSTALL_PAK_SIZE"	TEXT,
-            "INSTALL_PAK_SHA512"	TEXT,
-            "SOURCE_PAK_PATH"	TEXT,
-            "SOURCE_PAK_SIZE"	TEXT,
-            "SOURCE_PAK_SHA512"	TEXT,
-            "DEPENDS2__RAW"	TEXT,
-            PRIMARY KEY("PKG_NAME")
-        );
-    )";
-    execTransactionSQL(SQL_CREATE_PACKAGE_INFO);
+    switch (mode)
+    {
+    case PARSE_MODE_MMAP:
+        result = parseAndBuildDatabase_Mapped(setupini_fileName, 1);
+        break;
+    case PARSE_MODE_PARALLEL:
+        result = parseAndBuildDatabase_Mapped(setupini_fileName, parseThreads > 0 ? parseThreads : max(1u, thread::hardware_concurrency()));
+        break;
+    default:
+        result = parseAndBuildDatabase_Stream(setupini_fileName);
+    }
 
-    /**
-     *  Create dependency map table
-     */
-    const char *SQL_CREATE_DEPENDENCY_MAP = R"(
-        DROP TABLE IF EXISTS "DEPENDENCY_MAP";
-
-        CREATE TABLE IF NOT EXISTS "DEPENDENCY_MAP" (
-            "ID" INTEGER PRIMARY KEY AUTOINCREMENT,
-	        "PKG_NAME"	TEXT NOT NULL,
-            "VERSION"   TEXT NOT NULL,
-	        "DEPENDS_ON"	TEXT NOT NULL,
-	        FOREIGN KEY("PKG_NAME") REFERENCES "PKG_INFO"("PKG_NAME")
-        );
-    )";
-    execTransactionSQL(SQL_CREATE_DEPENDENCY_MAP);
+    // A failed build is rolled back, leaving the catalog as it was (including tables dropped by createTable())
+    if (!sqlite3_get_autocommit(db))
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+    fullRebuild = false;
 
-    /**
-     * Create previous versions table
-     */
-    const char *SQL_CREATE_PREV_VERSIONS_TABLE = R"(
-        DROP TABLE IF EXISTS "PREV_VERSIONS";
-
-        CREATE TABLE IF NOT EXISTS "PREV_VERSIONS" (
-            "PKG_NAME"	TEXT NOT NULL,
-            "VERSION"	TEXT NOT NULL,
-            "INSTALL_PAK_PATH"	TEXT,
-            "INSTALL_PAK_SIZE"	TEXT,
-            "INSTALL_PAK_SHA512"	TEXT,
-            "SOURCE_PAK_PATH"	TEXT,
-            "SOURCE_PAK_SIZE"	TEXT,
-            "SOURCE_PAK_SHA512"	TEXT,
-            "DEPENDS2__RAW"	TEXT,
-            FOREIGN KEY ("PKG_NAME") REFERENCES "PKG_INFO"("PKG_NAME")
-        );
-    )";
-    execTransactionSQL(SQL_CREATE_PREV_VERSIONS_TABLE);
+    auto time_elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - time_start);
+    cerr << "> Build time: " << time_elapsed.count() << " ms (" << PROFILE_NAMES[profile] << " profile), peak RSS: " << getPeakRSS_KB() << " KB" << endl;
 
-    /**
-     * Commit transaction & Get result
-     */
-    errorLevel = commitTransaction();
-    if (errorLevel == 0)
-        cerr << "Tables created" << endl;
-    else
-        cerr << "Error while creating tables: " << zErrMsg << endl;
+    return result;
+}
 
-    return errorLevel;
+/**
+ * Pipeline of PARSE_MODE_STREAM: Batch size in packages, and how many batches can be in flight.
+ * Memory stays bounded by the queue, however large setup.ini is.
+ */
+static const size_t PACKAGES_PER_BATCH = 64;
+static const size_t PIPELINE_QUEUE_CAPACITY = 8;
+
+static double elapsedMs(chrono::steady_clock::time_point since)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
 }
 
-int CygpmDatabase::parseAndBuildDatabase(const char *setupini_fileName)
+/**
+ * Parser stage of PARSE_MODE_STREAM. Runs on its own thread, filling batches of the queue.
+ * Touches nothing but the scanner, the queue, header & the parser fields of stats.
+ */
+static void parseStreamIntoBatches(yyscan_t scanner, SPSCQueue<PackageBatch> &queue, SetupIniHeader &header, BuildPipelineStats &stats)
 {
     int token_type; // Lexer token type
 
@@ -156,636 +384,876 @@ int CygpmDatabase::parseAndBuildDatabase(const char *setupini_fileName)
      * Operation bits - controlling the switch cases' behaviour
      */
     bool is_adding_a_package = false;          // I'm manipulating a package's info
-    bool is_adding_a_YAML_section = false;     // I'm manipulating a YAML item
     bool is_adding_a_previous_version = false; // I'm manipulating a package's previous versions ("[prev]")
 
     /**
      * Buffer objects
+     * yytext is overwritten by the next token, so field text is copied into the batch's arena.
      */
-    CurrentPackageInfo *pkg_info = new CurrentPackageInfo;              // Current package's info
-    CurrentPrevPackageInfo *prev_pkg_info = new CurrentPrevPackageInfo; // Current package's previous version info
-    stringstream buff;                                                  // Buffer to build a YAML content
-    string last_YAML_section;                                           // The last YAML section to be committed
+    PackageBatch *batch = NULL;        // Batch being filled
+    PackageInfoView pkg_info;          // Current package's info
+    PrevPackageInfoView prev_pkg_info; // Current package's previous version info
+    string_view *current_field = NULL; // The field collecting tokens. NULL if current YAML item is not stored
+    string *header_field = NULL;       // The header field collecting tokens
 
-    int numPackages_SetupINI = 0; // Packages' count
-
-    // Initialize transaction
-    initTransaction();
-    if (errorLevel != 0)
-    {
-        cerr << "Error while building database: Transaction starting failed" << endl;
-        return -errorLevel;
-    }
+    auto time_start = chrono::steady_clock::now();
 
     /**
-     * Start parsing
+     * Take a free slot, waiting for the inserter if there's none. It's reused, so drop what it held.
      */
-    // Open setup.ini
-    yyrestart(fopen(setupini_fileName, "r"));
+    auto startBatch = [&]() {
+        batch = queue.tryAcquire();
+        if (batch == NULL)
+        {
+            auto wait_start = chrono::steady_clock::now();
+            batch = queue.acquire();
+            stats.parseWaitMs += elapsedMs(wait_start);
+        }
+
+        batch->arena.reset();
+        batch->packages = ArenaList<PackageInfoView>();
+        batch->prev_versions = ArenaList<PrevPackageInfoView>();
+    };
 
-    cerr << "Parsing setup.ini" << endl;
+    startBatch();
 
     // Call lexer
-    while (token_type = yylex())
+    while (token_type = yylex(scanner))
     {
+        YAMLKeyId key_id = YAML_KEY_UNKNOWN; // Which key a T_YAML_Key is
+        if (token_type >= T_YAML_Key)
+        {
+            key_id = YAML_KEY_ID(token_type);
+            token_type = T_YAML_Key;
+        }
+
+        char *yytext = yyget_text(scanner); // Current matched text
+        int yyleng = yyget_leng(scanner);   // Its length
+
         switch (token_type)
         {
         case T_Package_Name:
-            numPackages_SetupINI++; // Stat package count
-
             /**
-             * Submit the last package info before start a new one.
-             * If is_adding_a_package == true, there's a package to be added and committed.
+             * Submit the last package (and its last previous version) before starting a new one.
+             * Fields are already complete, no need to commit the last YAML item.
              */
             if (is_adding_a_package)
             {
-                // Remember that when a new package starts, the previous package's
-                //  last YAML item is also to be committed.
-                // Also should commit its previous version's YAML item.
-                if (is_adding_a_YAML_section)
-                    if (is_adding_a_previous_version)
-                        submitYAMLItem_PrevVersion(last_YAML_section, prev_pkg_info, buff);
-                    else
-                        submitYAMLItem(last_YAML_section, pkg_info, buff);
-
-                // Now submit our new package info
-                insertPackageInfo(pkg_info);
-
-                // Submit the last previous package's prev version info
+                batch->packages.push_back(batch->arena, pkg_info);
+
                 if (is_adding_a_previous_version)
-                    insertPrevPackageInfo(prev_pkg_info);
+                    batch->prev_versions.push_back(batch->arena, prev_pkg_info);
+            }
+
+            /**
+             * Hand a full batch to the inserter. A package never spans two batches.
+             */
+            if (batch->packages.size() >= PACKAGES_PER_BATCH)
+            {
+                queue.push();
+                startBatch();
             }
 
             /**
              * Start handling a new package.
              */
-            pkg_info = new CurrentPackageInfo; // Create a package info object
-            pkg_info->pkg_name = yytext;       // Set package name
+            pkg_info = PackageInfoView();
+            pkg_info.pkg_name = batch->arena.copy(yytext + 2, yyleng - 2); // Skip "@ "
 
             /**
              * Set operation bits.
              */
             is_adding_a_package = true;
             is_adding_a_previous_version = false;
-            is_adding_a_YAML_section = false;
+            current_field = NULL;
+            header_field = NULL;
 
             break;
 
         case T_YAML_Key:
-            // Ignore non-package YAML items
-            // TODO: Handle setup.ini's metadata
+            // Items before the first package are setup.ini's header
             if (!is_adding_a_package)
+            {
+                header_field = selectHeaderField(key_id, header);
+                if (header_field != NULL)
+                    header_field->clear();
                 break;
-
-            //cout << "[Current Tag] " << yytext << "; [Last Tag] " << last_YAML_section << endl;
-
-            is_adding_a_YAML_section = true;
+            }
 
             if (is_adding_a_previous_version)
-                submitYAMLItem_PrevVersion(last_YAML_section, prev_pkg_info, buff);
+                current_field = selectYAMLField_PrevVersion(key_id, prev_pkg_info);
             else
-                submitYAMLItem(last_YAML_section, pkg_info, buff);
+                current_field = selectYAMLField(key_id, pkg_info);
 
-            last_YAML_section = yytext;
+            if (current_field != NULL)
+                *current_field = string_view(); // A duplicated key overrides the former one
 
             break;
 
         case T_Prev_Version_Mark:
-            /**
-             * Remember that when a prev version starts, the last YAML item which positions
-             * before indicator "[prev]" is also to be committed.
-             */
-            if (is_adding_a_YAML_section)
-            {
-                if (is_adding_a_previous_version)
-                    submitYAMLItem_PrevVersion(last_YAML_section, prev_pkg_info, buff); // Submit the last prev version's one
-                else
-                    submitYAMLItem(last_YAML_section, pkg_info, buff); // Submit the main version's one
-            }
-
             /**
              * Check orphan [prev]. This is not allowed.
              */
-            if (pkg_info->pkg_name.length() <= 0)
+            if (pkg_info.pkg_name.empty())
             {
-                cerr << "Parse error: Orphan [prev] at " << yylineno << endl;
+                cerr << "Parse error: Orphan [prev] at " << yyget_lineno(scanner) << endl;
                 break;
             }
 
             /**
              * Submit the last previous version info before getting a new one.
-             * If is_adding_a_previous_version == true, there's a prev version to be added and committed.
              */
             if (is_adding_a_previous_version)
-            {
-                // Now submit our prev version info
-                insertPrevPackageInfo(prev_pkg_info);
-            }
+                batch->prev_versions.push_back(batch->arena, prev_pkg_info);
 
             /**
              * Start handling a new previous version.
              */
-            prev_pkg_info = new CurrentPrevPackageInfo;
-            prev_pkg_info->pkg_name = pkg_info->pkg_name;
+            prev_pkg_info = PrevPackageInfoView();
+            prev_pkg_info.pkg_name = pkg_info.pkg_name;
 
             /**
              * Set operation bits.
              */
             is_adding_a_previous_version = true;
-            is_adding_a_YAML_section = false;
+            current_field = NULL;
 
             break;
 
         case T_Multiline_String:
-            if (is_adding_a_YAML_section)
-            {
-                //cout << "Find string: " << yytext << endl;
-                buff.str(yytext);
-            }
+            if (current_field != NULL)
+                *current_field = batch->arena.copy(yytext, yyleng);
+            else if (header_field != NULL)
+                header_field->assign(yytext, yyleng);
             break;
 
         case T_Word:
-            if (is_adding_a_YAML_section)
+            // Words are joined by a single space, the same as in mapped mode
+            if (current_field != NULL)
+                *current_field = batch->arena.append(*current_field, yytext, yyleng, ' ');
+            else if (header_field != NULL)
             {
-                /**
-                 * Escape single quotation mark "'"
-                 */
-                for (int i = 0; i < strlen(yytext); i++)
-                {
-                    switch (yytext[i])
-                    {
-                    case '\'':
-                        buff << "''";
-                        break;
-                    default:
-                        buff << yytext[i];
-                    }
-                }
-                buff << " ";
+                if (!header_field->empty())
+                    *header_field += ' ';
+                header_field->append(yytext, yyleng);
             }
-            //buff << yytext << " ";
             break;
         }
     }
 
     /**
-     * Remember to add the last package
-     * NOTICE: This section is same as the one in the lexer loop -> case "T_Package_Name".
+     * Remember to add the last package, then flush the last batch
      */
     if (is_adding_a_package)
     {
-        // Remember that when a new package starts, the previous package's
-        //  last YAML item is also to be committed.
-        // Also should commit its previous version's YAML item.
-        if (is_adding_a_YAML_section)
-            if (is_adding_a_previous_version)
-                submitYAMLItem_PrevVersion(last_YAML_section, prev_pkg_info, buff);
-            else
-                submitYAMLItem(last_YAML_section, pkg_info, buff);
+        batch->packages.push_back(batch->arena, pkg_info);
 
-        // Now submit our new package info
-        insertPackageInfo(pkg_info);
-
-        // Submit the last previous package's prev version info
         if (is_adding_a_previous_version)
-            insertPrevPackageInfo(prev_pkg_info);
+            batch->prev_versions.push_back(batch->arena, prev_pkg_info);
     }
 
-    /**
-     * Commit transaction & Get result
-     */
-    errorLevel = commitTransaction();
-    if (errorLevel == 0)
-        cerr << "Built setup.ini database" << endl;
-    else
-    {
-        cerr << "Error while building database: " << zErrMsg << endl;
-        return -errorLevel;
-    }
+    if (batch->packages.size() > 0)
+        queue.push();
 
-    return numPackages_SetupINI;
+    stats.parseMs = elapsedMs(time_start);
+    queue.close();
 }
 
-int CygpmDatabase::buildDependencyMap()
+int CygpmDatabase::parseAndBuildDatabase_Stream(const char *setupini_fileName)
 {
-    /* Variables */
-    char **dbResult; // Results from sqlite3_get_table()
-    int nRow;        // Row count
-    int nColumn;     // Column count
-    int i, j;        // Loop variable
+    yyscan_t scanner;      // Lexer object, owned by this call
+    SetupIniHeader header; // setup.ini's header. Filled by the parser thread
 
-    /**
-     * NOTICE: In sqlite3_get_table(), dbResult's column values are successive. 
-     * It stores the dimension table (traditional RxC) into a flat array.
-     * So, dbResult[0, nColumn - 1] are column names, dbResult[nColumn, len(dbResult)] are column values.
-     */
-    int nIndex; // Current index of dbResult
-
-    /* SQL query */
-    const char *SQL_GET_REQUIRES__RAW = R"(
-        SELECT PKG_NAME,VERSION,REQUIRES__RAW FROM PKG_INFO;
-    )";
-    const char *SQL_GET_PREV_DEPENDS2__RAW = R"(
-        SELECT PKG_NAME,VERSION,DEPENDS2__RAW FROM PREV_VERSIONS;
-    )";
-
-    /* Initialize transaction */
-    initTransaction();
+    int numPackages_SetupINI = 0; // Packages' count
+
+    // Initialize transaction, unless createTable() has begun a full rebuild
+    if (!fullRebuild)
+        initTransaction();
     if (errorLevel != 0)
     {
-        cerr << "Error while building dependency map: Transaction starting failed" << endl;
-        return errorLevel;
+        cerr << "Error while building database: Transaction starting failed" << endl;
+        return -errorLevel;
     }
 
-    cerr << "Building dependency map" << endl;
-
-    ///////////////////////////// CURRENT VERSION /////////////////////////////
-
     /**
-     * Execute SQL statement to get requires__raw data 
+     * Start parsing
      */
-    rc = sqlite3_get_table(db, SQL_GET_REQUIRES__RAW, &dbResult, &nRow, &nColumn, &zErrMsg);
-    if (rc != SQLITE_OK)
+    // Open setup.ini. If it's compressed, it will be decompressed on the fly.
+    SetupIniReader setupini;
+    if (setupini.open(setupini_fileName) != CPM_OK)
     {
-        cerr << "SQL error: " << zErrMsg << endl;
+        cerr << "Error while building database: Cannot open " << setupini_fileName << endl;
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        return -CPM_FILE_ACCESS_ERROR;
+    }
 
-        SQLITE_ERR_RETURN;
+    if (yylex_init_extra(setupini.getLexerInput(), &scanner) != 0) // Lexer reads via setupini
+    {
+        cerr << "Error while building database: Failed to create lexer" << endl;
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        return -CPM_UNEXPECTED_ERROR;
     }
 
+    if (setupini.getCompression() == COMPRESSION_NONE)
+        cerr << "Parsing setup.ini" << endl;
+    else
+        cerr << "Parsing setup.ini (decompressing on the fly)" << endl;
+
     /**
-     * Start parsing requires__raw.
-     * Parse each package's requires__raw respectively.
+     * Two stages: The parser thread lexes setup.ini into batches, while this thread (which owns the
+     * connection) inserts them. So lexing & decompressing overlap with SQLite's work.
+     * The parser thread owns the scanner & setupini until it's joined.
      */
-    nIndex = nColumn; // Initialize nIndex
-    for (i = 0; i < nRow; i++)
+    SPSCQueue<PackageBatch> queue(PIPELINE_QUEUE_CAPACITY);
+    size_t depth_sum = 0;
+
+    pipelineStats = BuildPipelineStats();
+    pipelineStats.queueCapacity = queue.capacity();
+
+    auto time_start = chrono::steady_clock::now();
+    thread parser(parseStreamIntoBatches, scanner, ref(queue), ref(header), ref(pipelineStats));
+
+    while (true)
     {
-        // Run parser
-        // There will be only three columns: PKG_NAME, VERSION, REQUIRES_RAW.
-        parseRequiresRaw(dbResult[nIndex], dbResult[nIndex + 1], dbResult[nIndex + 2]);
+        PackageBatch *batch = queue.tryFront();
+        if (batch == NULL)
+        {
+            auto wait_start = chrono::steady_clock::now();
+            batch = queue.front();
+            pipelineStats.insertWaitMs += elapsedMs(wait_start);
+
+            if (batch == NULL)
+                break; // Parser is done
+        }
 
-        nIndex += 3; // Go to the next row
+        size_t depth = queue.size();
+        depth_sum += depth;
+        pipelineStats.maxQueueDepth = max(pipelineStats.maxQueueDepth, depth);
+        pipelineStats.numBatches++;
+
+        batch->packages.forEach([&](const PackageInfoView &pkg_info) { insertPackageInfo(pkg_info); });
+        batch->prev_versions.forEach([&](const PrevPackageInfoView &prev_pkg_info) { insertPrevPackageInfo(prev_pkg_info); });
+        numPackages_SetupINI += batch->packages.size();
+
+        /**
+         * Hand the batch back to the parser, which overwrites it. Statements still bind its text as SQLITE_STATIC,
+         * but bindings are only read by sqlite3_step(), and every insert rebinds all its parameters before that.
+         */
+        queue.pop();
     }
 
-    ///////////////////////////// PREV VERSION /////////////////////////////
+    pipelineStats.insertMs = elapsedMs(time_start);
+    parser.join();
+    yylex_destroy(scanner);
+
+    if (pipelineStats.numBatches > 0)
+        pipelineStats.meanQueueDepth = (double)depth_sum / pipelineStats.numBatches;
 
     /**
-     * Execute SQL statement to get depends2__raw data 
+     * Statements must not hold any SQLITE_STATIC binding to the batches, which are released on return.
      */
-    rc = sqlite3_get_table(db, SQL_GET_PREV_DEPENDS2__RAW, &dbResult, &nRow, &nColumn, &zErrMsg);
-    if (rc != SQLITE_OK)
-    {
-        cerr << "SQL error: " << zErrMsg << endl;
+    clearStatementBindings();
 
-        SQLITE_ERR_RETURN;
+    size_t arena_peak = 0, arena_chunks = 0;
+    for (size_t i = 0; i < queue.capacity(); i++)
+    {
+        arena_peak += queue.slot(i).arena.getPeakUsedBytes();
+        arena_chunks += queue.slot(i).arena.getNumChunks();
     }
 
+    cerr << "> Arena: peak " << (arena_peak + 1023) / 1024 << " KB in " << arena_chunks << " chunk(s)" << endl;
+    cerr << "> Pipeline: " << pipelineStats.numBatches << " batch(es), queue depth " << fixed << setprecision(1)
+         << pipelineStats.meanQueueDepth << " on average, " << pipelineStats.maxQueueDepth << " at most (of " << pipelineStats.queueCapacity << ")" << endl;
+    cerr << "> Parser " << pipelineStats.parseMs << " ms (waited " << pipelineStats.parseWaitMs << " ms), inserter "
+         << pipelineStats.insertMs << " ms (waited " << pipelineStats.insertWaitMs << " ms)" << defaultfloat << endl;
+
     /**
-     * Start parsing depends2__raw.
-     * Parse each package's depends2__raw respectively.
+     * Broken input. Discard everything.
      */
-    nIndex = nColumn; // Initialize nIndex
-    for (i = 0; i < nRow; i++)
+    if (setupini.getHasError())
     {
-        // Run parser
-        // There will be only three columns: PKG_NAME, VERSION, DEPENDS2_RAW.
-        parseDepends2(dbResult[nIndex], dbResult[nIndex + 1], dbResult[nIndex + 2]);
-
-        nIndex += 3; // Go to the next row
+        cerr << "Error while building database: Failed to read " << setupini_fileName << endl;
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        return -CPM_DECOMPRESS_ERROR;
     }
 
-    //////////////////////////////// FINALIZE ////////////////////////////////
+    updateSearchIndex();
+    storeMetadata(header);
+    if (fullRebuild)
+        createIndexes(); // Committed along with the catalog
 
     /**
      * Commit transaction & Get result
      */
     errorLevel = commitTransaction();
     if (errorLevel == 0)
-        cerr << "Dependency map built" << endl;
+        cerr << "Built setup.ini database" << endl;
     else
-        cerr << "Error while building dependency map: " << zErrMsg << endl;
+    {
+        cerr << "Error while building database: " << zErrMsg << endl;
+        return -errorLevel;
+    }
 
-    return errorLevel;
+    return numPackages_SetupINI;
 }
 
-inline void CygpmDatabase::submitYAMLItem(string YAML_section, CurrentPackageInfo *pkg_info, stringstream &buff)
+int CygpmDatabase::buildDependencyMap()
 {
-    if (YAML_SECTION_IS("sdesc:"))
-    {
-        pkg_info->sdesc = buff.str();
-    }
-    else if (YAML_SECTION_IS("ldesc:"))
-    {
-        pkg_info->ldesc = buff.str();
-    }
-    else if (YAML_SECTION_IS("category:"))
-    {
-        pkg_info->category = buff.str();
-    }
-    else if (YAML_SECTION_IS("requires:"))
-    {
-        pkg_info->requires__raw = buff.str();
-    }
-    else if (YAML_SECTION_IS("version:"))
-    {
-        pkg_info->version = buff.str();
-    }
-    else if (YAML_SECTION_IS("install:"))
+    /**
+     * The map itself is filled while parsing: Each version's dependencies are inserted along with it
+     * (see insertPackageInfo()), or converted by migrateSchema(). Nothing is read back, only the graph is left.
+     */
+    return buildDependencyGraph();
+}
+
+int CygpmDatabase::buildDependencyGraph()
+{
+    vector<string> names;                         // Node -> name, sorted
+    unordered_map<sqlite3_int64, uint32_t> nodes; // Name ID -> node
+    vector<pair<uint32_t, uint32_t>> edges;       // (dependent, dependency)
+
+    auto time_start = chrono::steady_clock::now();
+
+    /**
+     * Nodes are numbered in name order, so that the graph can find names by binary search.
+     * SQLite's BINARY collation compares as memcmp(), the same as string_view.
+     */
+    StatementCursor name_rows(db, R"(SELECT ID, NAME FROM "PACKAGE_NAMES" ORDER BY NAME;)");
+    while (name_rows.next())
     {
-        pkg_info->install__raw = buff.str();
+        nodes.emplace(name_rows.getInt64(0), names.size());
+        names.push_back(name_rows.getString(1));
     }
-    else if (YAML_SECTION_IS("source:"))
+
+    /**
+     * Edges of current versions, in the order they're listed
+     */
+    StatementCursor edge_rows(db, R"(
+        SELECT V.PACKAGE_ID, D.DEPENDS_ON
+        FROM "VERSIONS" V JOIN "DEPENDENCIES" D ON D.VERSION_ID = V.ID
+        WHERE V.IS_CURRENT = 1 ORDER BY D.rowid;
+    )");
+    while (name_rows.isDone() && edge_rows.next())
     {
-        pkg_info->source__raw = buff.str();
+        auto dependent = nodes.find(edge_rows.getInt64(0));
+        auto dependency = nodes.find(edge_rows.getInt64(1));
+        if (dependent != nodes.end() && dependency != nodes.end())
+            edges.emplace_back(dependent->second, dependency->second);
     }
-    else if (YAML_SECTION_IS("depends2:"))
+
+    if (!name_rows.isDone() || !edge_rows.isDone())
     {
-        pkg_info->depends2__raw = buff.str();
+        cerr << "Error while building dependency graph: " << sqlite3_errmsg(db) << endl;
+
+        SQLITE_ERR_RETURN;
     }
 
-    buff.str("");
-    if (buff.str().length() > 0)
-        cerr << "BUFF IS NOT CLEAN!" << endl;
+    dependencyGraph.assign(names, edges, getCatalogStamp());
+
+    auto time_elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - time_start);
+    cerr << "> Dependency graph: " << dependencyGraph.getNumNodes() << " nodes, " << dependencyGraph.getNumEdges()
+         << " edges, built in " << time_elapsed.count() << " ms" << endl;
+
+    return 0;
 }
 
-inline void CygpmDatabase::submitYAMLItem_PrevVersion(string YAML_section, CurrentPrevPackageInfo *prev_pkg_info, stringstream &buff)
+const DependencyGraph &CygpmDatabase::getDependencyGraph()
 {
-    if (YAML_SECTION_IS("version:"))
-    {
-        prev_pkg_info->version = buff.str();
-    }
-    else if (YAML_SECTION_IS("install:"))
-    {
-        prev_pkg_info->install__raw = buff.str();
-    }
-    else if (YAML_SECTION_IS("source:"))
+    if (dependencyGraph.isEmpty())
+        buildDependencyGraph();
+
+    return dependencyGraph;
+}
+
+int CygpmDatabase::saveDependencyGraph(const char *graph_fileName)
+{
+    return getDependencyGraph().isEmpty() ? CPM_UNEXPECTED_ERROR : dependencyGraph.save(graph_fileName);
+}
+
+int CygpmDatabase::loadDependencyGraph(const char *graph_fileName)
+{
+    return dependencyGraph.open(graph_fileName, getCatalogStamp());
+}
+
+int CygpmDatabase::saveCatalogCache(const char *cache_fileName)
+{
+    const DependencyGraph &graph = getDependencyGraph();
+    if (graph.isEmpty())
+        return CPM_UNEXPECTED_ERROR;
+
+    auto time_start = chrono::steady_clock::now();
+
+    /**
+     * Records of all names (including those only depended on), in the graph's node order
+     */
+    vector<string> names;
+    vector<PackageRecord> records;
+
+    names.reserve(graph.getNumNodes());
+    for (uint32_t node = 0; node < graph.getNumNodes(); node++)
+        names.push_back(string(graph.getName(node)));
+
+    if (getPackageRecords(names, NULL, records) != SQLITE_OK)
     {
-        prev_pkg_info->source__raw = buff.str();
+        cerr << "Error while saving catalog cache: " << sqlite3_errmsg(db) << endl;
+        return CPM_UNEXPECTED_ERROR;
     }
-    else if (YAML_SECTION_IS("depends2:"))
+
+    int result = CatalogCache::write(cache_fileName, graph, records);
+    if (result == CPM_OK)
     {
-        prev_pkg_info->depends2__raw = buff.str();
+        auto time_elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - time_start);
+        cerr << "> Catalog cache: " << names.size() << " names, saved in " << time_elapsed.count() << " ms" << endl;
     }
 
-    buff.str("");
-    if (buff.str().length() > 0)
-        cerr << "BUFF IS NOT CLEAN!" << endl;
+    return result;
 }
 
-void CygpmDatabase::insertPackageInfo(CurrentPackageInfo *packageInfo)
+uint64_t CygpmDatabase::getCatalogStamp()
 {
-    /* Pre-defined SQL query */
-    const char *SQL_INSERT_PACKAGE_INFO = R"(
-        INSERT INTO "PKG_INFO" (PKG_NAME, SDESC, LDESC, CATEGORY, REQUIRES__RAW, VERSION, 
-                                INSTALL_PAK_PATH, INSTALL_PAK_SIZE, INSTALL_PAK_SHA512, 
-                                SOURCE_PAK_PATH, SOURCE_PAK_SIZE, SOURCE_PAK_SHA512, 
-                                DEPENDS2__RAW)
-        VALUES (:pkg_name, :sdesc, :ldesc, :category, :requires__raw, :version, 
-                :install_pak_path, :install_pak_size, :install_pak_sha512, 
-                :source_pak_path, :source_pak_size, :source_pak_sha512, 
-                :depends2__raw);
-    )";
-    sqlite3_stmt *stmt = NULL; // SQLite statement
-    int rc;                    // Return value for command
+    SetupIniHeader header;
 
-    /* Prepare statement binding */
-    rc = sqlite3_prepare_v2(db, SQL_INSERT_PACKAGE_INFO, -1, &stmt, NULL);
-    if (rc != SQLITE_OK)
+    return loadMetadata(header) ? header.getStamp() : 0;
+}
+
+/**
+ * Split an install/source item ("<path> <size> <sha512>") into its three parts.
+ */
+static void splitPakInfo(string_view raw, string_view &path, string_view &size, string_view &sha512)
+{
+    string_view *parts[3] = {&path, &size, &sha512};
+
+    for (int i = 0; i < 3; i++)
     {
-        cerr << "! Failed to prepare binding for " << packageInfo->pkg_name << endl;
-        return;
+        size_t start = raw.find_first_not_of(" \t");
+        if (start == string_view::npos)
+        {
+            *parts[i] = string_view();
+            continue;
+        }
+
+        raw.remove_prefix(start);
+        size_t end = raw.find_first_of(" \t");
+        *parts[i] = raw.substr(0, end);
+        raw.remove_prefix(parts[i]->length());
     }
+}
 
-    /* Preprocess package name data */
-    char pkg_name[packageInfo->pkg_name.length() + 1];
-    sscanf(packageInfo->pkg_name.c_str(), "@ %s", pkg_name);
+/**
+ * Bind a pak size as INTEGER. Empty one is NULL. Anything else than digits is kept as text by the column's affinity.
+ */
+static void bindPakSize(sqlite3_stmt *stmt, const char *zName, string_view size)
+{
+    int index = sqlite3_bind_parameter_index(stmt, zName);
 
-    /* Preprocess install/source data */
-    const int LEN_INSTALL__RAW = packageInfo->install__raw.length() + 1,
-              LEN_SOURCE__RAW = packageInfo->source__raw.length() + 1;
-    char install_pak_path[LEN_INSTALL__RAW] = "", install_pak_size[LEN_INSTALL__RAW] = "", install_pak_sha512[LEN_INSTALL__RAW] = "";
-    char source_pak_path[LEN_SOURCE__RAW] = "", source_pak_size[LEN_SOURCE__RAW] = "", source_pak_sha512[LEN_SOURCE__RAW] = "";
+    if (size.empty())
+        sqlite3_bind_null(stmt, index);
+    else
+        sqlite3_bind_text(stmt, index, size.data(), size.length(), SQLITE_STATIC); // INTEGER affinity converts it
+}
+
+/**
+ * Bind a SHA512 digest as a 64-byte BLOB. Empty one is NULL. If it's not hex, keep it as text,
+ * so that it reads back unchanged.
+ */
+static void bindPakDigest(sqlite3_stmt *stmt, const char *zName, string_view sha512)
+{
+    int index = sqlite3_bind_parameter_index(stmt, zName);
+    unsigned char digest[64];
+
+    if (sha512.empty())
+        sqlite3_bind_null(stmt, index);
+    else if (size_t digestSize = decodeHex(sha512.data(), sha512.length(), digest, sizeof(digest)))
+        sqlite3_bind_blob(stmt, index, digest, digestSize, SQLITE_TRANSIENT);
+    else
+        sqlite3_bind_text(stmt, index, sha512.data(), sha512.length(), SQLITE_STATIC);
+}
 
-    sscanf(packageInfo->install__raw.c_str(), "%s %s %s", install_pak_path, install_pak_size, install_pak_sha512);
-    sscanf(packageInfo->source__raw.c_str(), "%s %s %s", source_pak_path, source_pak_size, source_pak_sha512);
+sqlite3_int64 CygpmDatabase::insertPackageInfo(const PackageInfoView &packageInfo)
+{
+    sqlite3_stmt *stmt = getStatement(STMT_INSERT_PACKAGE_INFO); // SQLite statement
+    int rc;                                                      // Return value for command
+
+    sqlite3_int64 package_id = getNameId(packageInfo.pkg_name);
+    if (stmt == NULL || package_id == 0)
+    {
+        cerr << "! Failed to prepare binding for " << packageInfo.pkg_name << endl;
+        return 0;
+    }
 
     /* Bind sections with values */
     // Every command here is a macro of sqlite3_bind_text().
-    SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
-    SQLITE_BIND_MY_COLUMN(":sdesc", packageInfo->sdesc.c_str());
-    SQLITE_BIND_MY_COLUMN(":ldesc", packageInfo->ldesc.c_str());
-    SQLITE_BIND_MY_COLUMN(":category", packageInfo->category.c_str());
-    SQLITE_BIND_MY_COLUMN(":requires__raw", packageInfo->requires__raw.c_str());
-    SQLITE_BIND_MY_COLUMN(":version", packageInfo->version.c_str());
-    SQLITE_BIND_MY_COLUMN(":install_pak_path", install_pak_path);
-    SQLITE_BIND_MY_COLUMN(":install_pak_size", install_pak_size);
-    SQLITE_BIND_MY_COLUMN(":install_pak_sha512", install_pak_sha512);
-    SQLITE_BIND_MY_COLUMN(":source_pak_path", source_pak_path);
-    SQLITE_BIND_MY_COLUMN(":source_pak_size", source_pak_size);
-    SQLITE_BIND_MY_COLUMN(":source_pak_sha512", source_pak_sha512);
-    SQLITE_BIND_MY_COLUMN(":depends2__raw", packageInfo->depends2__raw.c_str());
+    sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":package_id"), package_id);
+    SQLITE_BIND_MY_COLUMN_VIEW(":sdesc", packageInfo.sdesc);
+    SQLITE_BIND_MY_COLUMN_VIEW(":ldesc", packageInfo.ldesc);
+    SQLITE_BIND_MY_COLUMN_VIEW(":category", packageInfo.category);
+    SQLITE_BIND_MY_COLUMN_VIEW(":obsoletes__raw", packageInfo.obsoletes__raw);
+    SQLITE_BIND_MY_COLUMN_VIEW(":provides__raw", packageInfo.provides__raw);
+    SQLITE_BIND_MY_COLUMN_VIEW(":conflicts__raw", packageInfo.conflicts__raw);
+    sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":block_hash"), (sqlite3_int64)packageInfo.block_hash);
 
     /* Step (execute) the rendered statement */
     rc = sqlite3_step(stmt);
+
+    /* Reset statement for the next package */
+    sqlite3_reset(stmt);
+
     if ((rc != SQLITE_DONE) && (rc != SQLITE_ROW))
     {
-        cerr << "! Failed to execute binding for " << pkg_name << ": " << sqlite3_errmsg(db) << endl;
-        return;
+        cerr << "! Failed to execute binding for " << packageInfo.pkg_name << ": " << sqlite3_errmsg(db) << endl;
+        return 0; // Don't add a second current version to a duplicated package
     }
 
-    /* Finalize (clean up) the statement */
-    sqlite3_finalize(stmt);
+    sqlite3_int64 version_id = insertVersion(package_id, packageInfo.version, true, packageInfo.requires__raw,
+                                             packageInfo.depends2__raw, packageInfo.install__raw, packageInfo.source__raw);
+
+    // Dependency map of current version: requires, space-separated
+    if (version_id != 0)
+        insertDependencies(version_id, packageInfo.requires__raw, ' ');
+
+    return version_id;
 }
 
-void CygpmDatabase::insertPrevPackageInfo(CurrentPrevPackageInfo *prevPackageInfo)
+sqlite3_int64 CygpmDatabase::insertPrevPackageInfo(const PrevPackageInfoView &prevPackageInfo)
 {
-    /* Pre-defined SQL query */
-    const char *SQL_INSERT_PREV_PACKAGE_INFO = R"(
-        INSERT INTO "PREV_VERSIONS" (PKG_NAME, VERSION, 
-                                    INSTALL_PAK_PATH, INSTALL_PAK_SIZE, INSTALL_PAK_SHA512, 
-                                    SOURCE_PAK_PATH, SOURCE_PAK_SIZE, SOURCE_PAK_SHA512, 
-                                    DEPENDS2__RAW)
-        VALUES (:pkg_name, :version, 
-                :install_pak_path, :install_pak_size, :install_pak_sha512, 
-                :source_pak_path, :source_pak_size, :source_pak_sha512, 
-                :depends2__raw);
-    )";
+    sqlite3_int64 package_id = getNameId(prevPackageInfo.pkg_name);
+    if (package_id == 0)
+    {
+        cerr << "! Failed to prepare binding for " << prevPackageInfo.pkg_name << endl;
+        return 0;
+    }
 
-    sqlite3_stmt *stmt = NULL; // SQLite statement
-    int rc;                    // Return value for command
+    sqlite3_int64 version_id = insertVersion(package_id, prevPackageInfo.version, false, string_view(),
+                                             prevPackageInfo.depends2__raw, prevPackageInfo.install__raw, prevPackageInfo.source__raw);
 
-    /* Prepare statement binding */
-    rc = sqlite3_prepare_v2(db, SQL_INSERT_PREV_PACKAGE_INFO, -1, &stmt, NULL);
-    if (rc != SQLITE_OK)
+    // Dependency map of previous version: depends2, comma-separated
+    if (version_id != 0)
+        insertDependencies(version_id, prevPackageInfo.depends2__raw, ',');
+
+    return version_id;
+}
+
+sqlite3_int64 CygpmDatabase::insertVersion(sqlite3_int64 package_id, string_view version, bool is_current, string_view requires__raw,
+                                           string_view depends2__raw, string_view install__raw, string_view source__raw)
+{
+    sqlite3_stmt *stmt = getStatement(STMT_INSERT_VERSION); // SQLite statement
+    int rc;                                                 // Return value for command
+
+    if (stmt == NULL)
     {
-        cerr << "! Failed to prepare binding for " << prevPackageInfo->pkg_name << endl;
-        return;
+        cerr << "! Failed to prepare binding for version " << version << endl;
+        return 0;
     }
 
-    /* Preprocess package name data */
-    char pkg_name[prevPackageInfo->pkg_name.length() + 1];
-    sscanf(prevPackageInfo->pkg_name.c_str(), "@ %s", pkg_name);
-
     /* Preprocess install/source data */
-    const int LEN_INSTALL__RAW = prevPackageInfo->install__raw.length() + 1,
-              LEN_SOURCE__RAW = prevPackageInfo->source__raw.length() + 1;
-    char install_pak_path[LEN_INSTALL__RAW] = "", install_pak_size[LEN_INSTALL__RAW] = "", install_pak_sha512[LEN_INSTALL__RAW] = "";
-    char source_pak_path[LEN_SOURCE__RAW] = "", source_pak_size[LEN_SOURCE__RAW] = "", source_pak_sha512[LEN_SOURCE__RAW] = "";
+    string_view install_pak_path, install_pak_size, install_pak_sha512;
+    string_view source_pak_path, source_pak_size, source_pak_sha512;
 
-    sscanf(prevPackageInfo->install__raw.c_str(), "%s %s %s", install_pak_path, install_pak_size, install_pak_sha512);
-    sscanf(prevPackageInfo->source__raw.c_str(), "%s %s %s", source_pak_path, source_pak_size, source_pak_sha512);
+    splitPakInfo(install__raw, install_pak_path, install_pak_size, install_pak_sha512);
+    splitPakInfo(source__raw, source_pak_path, source_pak_size, source_pak_sha512);
 
     /* Bind sections with values */
-    // Every command here is a macro of sqlite3_bind_text().
-    SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
-    SQLITE_BIND_MY_COLUMN(":version", prevPackageInfo->version.c_str());
-    SQLITE_BIND_MY_COLUMN(":install_pak_path", install_pak_path);
-    SQLITE_BIND_MY_COLUMN(":install_pak_size", install_pak_size);
-    SQLITE_BIND_MY_COLUMN(":install_pak_sha512", install_pak_sha512);
-    SQLITE_BIND_MY_COLUMN(":source_pak_path", source_pak_path);
-    SQLITE_BIND_MY_COLUMN(":source_pak_size", source_pak_size);
-    SQLITE_BIND_MY_COLUMN(":source_pak_sha512", source_pak_sha512);
-    SQLITE_BIND_MY_COLUMN(":depends2__raw", prevPackageInfo->depends2__raw.c_str());
+    sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":package_id"), package_id);
+    SQLITE_BIND_MY_COLUMN_VIEW(":version", rtrimView(version)); // Stored trimmed, so lookups can match it exactly
+    makeVersionKey(version, versionKey);
+    sqlite3_bind_blob(stmt, sqlite3_bind_parameter_index(stmt, ":version_key"), versionKey.data(), versionKey.length(), SQLITE_STATIC);
+    sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":is_current"), is_current);
+    SQLITE_BIND_MY_COLUMN_VIEW(":requires__raw", requires__raw);
+    SQLITE_BIND_MY_COLUMN_VIEW(":depends2__raw", depends2__raw);
+    SQLITE_BIND_MY_COLUMN_VIEW(":install_pak_path", install_pak_path);
+    bindPakSize(stmt, ":install_pak_size", install_pak_size);
+    bindPakDigest(stmt, ":install_pak_sha512", install_pak_sha512);
+    SQLITE_BIND_MY_COLUMN_VIEW(":source_pak_path", source_pak_path);
+    bindPakSize(stmt, ":source_pak_size", source_pak_size);
+    bindPakDigest(stmt, ":source_pak_sha512", source_pak_sha512);
 
     /* Step (execute) the rendered statement */
     rc = sqlite3_step(stmt);
+
+    /* Reset statement for the next version */
+    sqlite3_reset(stmt);
+
     if ((rc != SQLITE_DONE) && (rc != SQLITE_ROW))
     {
-        cerr << "! Failed to execute binding for " << pkg_name << ": " << sqlite3_errmsg(db) << endl;
-        return;
+        cerr << "! Failed to execute binding for version " << version << ": " << sqlite3_errmsg(db) << endl;
+        return 0;
     }
 
-    /* Finalize (clean up) the statement */
-    sqlite3_finalize(stmt);
+    return sqlite3_last_insert_rowid(db);
 }
 
-inline void CygpmDatabase::parseRequiresRaw(char *pkg_name, char *version, char *requires__raw)
+sqlite3_int64 CygpmDatabase::getNameId(string_view pkg_name)
 {
-    /* SQL statements */
-    const char *SQL_INSERT_DEPENDENCY_MAP_ITEM = R"(
-        INSERT INTO "DEPENDENCY_MAP" (PKG_NAME, VERSION, DEPENDS_ON)
-        VALUES (:pkg_name, :version, :depends_on);
-    )"; // Pre-defined SQL query
+    string name(pkg_name);
+    sqlite3_int64 name_id = 0;
 
-    sqlite3_stmt *stmt = NULL; // SQLite statement
-    int rc;                    // Return value for command
+    auto cached = nameIds.find(name);
+    if (cached != nameIds.end())
+        return cached->second;
 
-    /**
-     * Prepare statement binding
-     */
-    rc = sqlite3_prepare_v2(db, SQL_INSERT_DEPENDENCY_MAP_ITEM, -1, &stmt, NULL);
-    if (rc != SQLITE_OK)
+    sqlite3_stmt *stmt = getStatement(STMT_INSERT_NAME);
+    if (stmt == NULL)
+        return 0;
+
+    /* Add the name if it's new. Either way, look up its ID then */
+    SQLITE_BIND_MY_COLUMN_VIEW(":name", pkg_name);
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE)
     {
-        cerr << "! Failed to prepare binding for " << pkg_name << endl;
+        cerr << "! Failed to add package name " << pkg_name << ": " << sqlite3_errmsg(db) << endl;
+        return 0;
+    }
+
+    stmt = getStatement(STMT_GET_NAME_ID);
+    if (stmt == NULL)
+        return 0;
+
+    SQLITE_BIND_MY_COLUMN_VIEW(":name", pkg_name);
+    StatementCursor cursor(stmt);
+    if (cursor.next())
+        name_id = cursor.getInt64(0);
+
+    if (name_id != 0)
+        nameIds.emplace(move(name), name_id);
+
+    return name_id;
+}
+
+void CygpmDatabase::insertDependencies(sqlite3_int64 version_id, string_view dependencies__raw, char splitter)
+{
+    sqlite3_stmt *stmt = getStatement(STMT_INSERT_DEPENDENCY); // SQLite statement
+    int rc;                                                    // Return value for command
+
+    if (stmt == NULL)
+    {
+        cerr << "! Failed to prepare binding for dependencies of version #" << version_id << endl;
         return;
     }
 
     /**
-     * Parse requires__raw
+     * Split dependencies__raw by splitter, trimming spaces around each item.
+     * Works on views, so nothing is copied (unlike strtok()).
      */
-    const char *splitter = " "; // strtok()'s splitter
-    char *token;                // Child string
+    while (!dependencies__raw.empty())
+    {
+        size_t end = dependencies__raw.find(splitter);
+        string_view token = dependencies__raw.substr(0, end);
+        dependencies__raw.remove_prefix(end == string_view::npos ? dependencies__raw.length() : end + 1);
 
-    /* strtok() will modify its source! So we'd better make a copy. */
-    char *tmp = new char[strlen(requires__raw) + 1];
-    strcpy(tmp, requires__raw);
+        size_t first = token.find_first_not_of(" \t\r\n");
+        if (first == string_view::npos)
+            continue;
+        token = token.substr(first, token.find_last_not_of(" \t\r\n") - first + 1);
 
-    /* Split the requires__raw */
-    token = strtok(tmp, splitter); // Get the first child string
+        // Dependencies refer to names, which may not be packages in setup.ini
+        sqlite3_int64 depends_on = getNameId(token);
+        if (depends_on == 0)
+            continue;
 
-    // Get the remainders
-    while (token != NULL)
-    {
-        /* Add a dependency item to database */
         // Bind columns
-        SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
-        SQLITE_BIND_MY_COLUMN(":version", version);
-        SQLITE_BIND_MY_COLUMN(":depends_on", token);
+        sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":version_id"), version_id);
+        sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":depends_on"), depends_on);
 
         // Step (execute) the rendered statement
         rc = sqlite3_step(stmt);
         if ((rc != SQLITE_DONE) && (rc != SQLITE_ROW))
-        {
-            cerr << "! Failed to execute binding for " << pkg_name << ": " << sqlite3_errmsg(db) << endl;
-            return;
-        }
+            cerr << "! Failed to execute binding for " << token << ": " << sqlite3_errmsg(db) << endl;
 
-        // Reset statement for the next execution
-        // If not reset, SQLite will always use the previous values.
         sqlite3_reset(stmt);
+    }
+}
 
-        /* Get the next remainder */
-        token = strtok(NULL, splitter);
+void CygpmDatabase::storeMetadata(const SetupIniHeader &header)
+{
+    sqlite3_stmt *stmt = getStatement(STMT_REPLACE_METADATA);
+    if (stmt == NULL)
+    {
+        cerr << "! Failed to prepare binding for metadata" << endl;
+        return;
     }
 
-    /**
-     * Finalize (clean up) the statement
-     */
-    sqlite3_finalize(stmt);
+    for (int i = 0; i < NUM_HEADER_FIELDS; i++)
+    {
+        SQLITE_BIND_MY_COLUMN(":key", SETUP_INI_HEADER_KEYS[i]);
+        SQLITE_BIND_MY_COLUMN(":value", header.fields[i].c_str());
+
+        if (sqlite3_step(stmt) != SQLITE_DONE)
+            cerr << "! Failed to store metadata " << SETUP_INI_HEADER_KEYS[i] << ": " << sqlite3_errmsg(db) << endl;
+
+        sqlite3_reset(stmt);
+    }
 }
 
-inline void CygpmDatabase::parseDepends2(char *pkg_name, char *version, char *depends2__raw)
+bool CygpmDatabase::loadMetadata(SetupIniHeader &header)
 {
-    /* SQL statements */
-    const char *SQL_INSERT_DEPENDENCY_MAP_ITEM = R"(
-        INSERT INTO "DEPENDENCY_MAP" (PKG_NAME, VERSION, DEPENDS_ON)
-        VALUES (:pkg_name, :version, :depends_on);
-    )"; // Pre-defined SQL query
+    int numFields = 0;
 
-    sqlite3_stmt *stmt = NULL; // SQLite statement
-    int rc;                    // Return value for command
+    // Fails if there's no METADATA table (database is not built yet, or built by an older version)
+    StatementCursor cursor(db, R"(SELECT KEY, VALUE FROM "METADATA";)");
+    if (cursor.getResult() != SQLITE_OK)
+        return false;
 
-    /**
-     * Prepare statement binding
-     */
-    rc = sqlite3_prepare_v2(db, SQL_INSERT_DEPENDENCY_MAP_ITEM, -1, &stmt, NULL);
-    if (rc != SQLITE_OK)
+    header = SetupIniHeader();
+    while (cursor.next())
     {
-        cerr << "! Failed to prepare binding for " << pkg_name << endl;
+        string_view key = cursor.getText(0);
+
+        string *field = header.selectField(key.data(), key.length());
+        if (field != NULL)
+        {
+            *field = cursor.getString(1);
+            numFields++;
+        }
+    }
+
+    return numFields > 0;
+}
+
+bool CygpmDatabase::isUpToDate(const char *setupini_fileName)
+{
+    SetupIniHeader stored, current;
+
+    auto time_start = chrono::steady_clock::now();
+
+    if (!hasCurrentSchema() || !loadMetadata(stored))
+        return false; // Never built, or couldn't be migrated
+
+    if (readSetupIniHeader(setupini_fileName, current) != CPM_OK)
+        return false; // Let a full build report the error
+
+    // A header without timestamp tells nothing about its content
+    if (current.fields[HEADER_SETUP_TIMESTAMP].empty() || !(stored == current))
+        return false;
+
+    auto time_elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - time_start);
+    cerr << "setup.ini is unchanged (setup-timestamp: " << current.fields[HEADER_SETUP_TIMESTAMP]
+         << "), checked in " << time_elapsed.count() << " ms" << endl;
+
+    return true;
+}
+
+void CygpmDatabase::deletePackageRows(string_view pkg_name)
+{
+    // Dependencies are found via versions, so delete them first. The name is kept, as other packages may depend on it
+    const StatementId STMT_DELETE_PACKAGE[3] = {STMT_DELETE_DEPENDENCIES, STMT_DELETE_VERSIONS, STMT_DELETE_PACKAGE_INFO};
+
+    sqlite3_int64 package_id = getNameId(pkg_name);
+    if (package_id == 0)
         return;
+
+    for (StatementId id : STMT_DELETE_PACKAGE)
+    {
+        sqlite3_stmt *stmt = getStatement(id);
+        if (stmt == NULL)
+        {
+            cerr << "! Failed to prepare deletion for " << pkg_name << endl;
+            continue;
+        }
+
+        sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":package_id"), package_id);
+        if (sqlite3_step(stmt) != SQLITE_DONE)
+            cerr << "! Failed to delete " << pkg_name << ": " << sqlite3_errmsg(db) << endl;
+
+        sqlite3_reset(stmt);
     }
+}
 
-    /**
-     * Parse requires__raw
-     */
-    const char *splitter = ","; // strtok()'s splitter
-    char *token;                // Child string
+sqlite3_stmt *CygpmDatabase::getStatement(StatementId id)
+{
+    sqlite3_stmt *&stmt = statements[id];
+
+    /* Prepare on first use. Statements survive DROP/CREATE TABLE, as SQLite re-prepares them on schema change */
+    if (stmt == NULL)
+    {
+        if (sqlite3_prepare_v3(db, STATEMENT_SQL[id], -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK)
+        {
+            cerr << "> Cannot prepare statement: " << sqlite3_errmsg(db) << endl;
+            sqlite3_finalize(stmt);
+            stmt = NULL;
+        }
+        return stmt;
+    }
 
-    /* strtok() will modify its source! So we'd better make a copy. */
-    char *tmp = new char[strlen(depends2__raw) + 1];
-    strcpy(tmp, depends2__raw);
+    sqlite3_reset(stmt); // In case the last user didn't
+    return stmt;
+}
 
-    /* Split the requires__raw */
-    token = strtok(tmp, splitter); // Get the first child string
+int CygpmDatabase::checkQueryPlans()
+{
+    // Statements run once per package (or per query). A full scan in any of them makes builds or queries O(n^2)
+    const StatementId STMT_LOOKUPS[] = {STMT_GET_NAME_ID, STMT_DELETE_PACKAGE_INFO, STMT_DELETE_VERSIONS, STMT_DELETE_DEPENDENCIES,
+                                        STMT_GET_PACKAGE, STMT_GET_PREV_VERSION, STMT_GET_PREV_VERSIONS, STMT_GET_NEWEST_VERSION, STMT_GET_VERSIONS_IN_RANGE,
+                                        STMT_GET_DEPENDENCIES, STMT_GET_CURRENT_DEPENDENCIES, STMT_GET_DEPENDENCIES_BY_ID};
+    int numScans = 0;
 
-    // Get the remainders
-    while (token != NULL)
+    for (StatementId id : STMT_LOOKUPS)
     {
-        /* Add a dependency item to database */
-        // Bind columns
-        SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
-        SQLITE_BIND_MY_COLUMN(":version", version);
-        SQLITE_BIND_MY_COLUMN(":depends_on", ltrim(token));
+        string sql = string("EXPLAIN QUERY PLAN ") + STATEMENT_SQL[id];
 
-        // Step (execute) the rendered statement
-        rc = sqlite3_step(stmt);
-        if ((rc != SQLITE_DONE) && (rc != SQLITE_ROW))
+        StatementCursor cursor(db, sql.c_str());
+        if (cursor.getResult() != SQLITE_OK)
         {
-            cerr << "! Failed to execute binding for " << pkg_name << ": " << sqlite3_errmsg(db) << endl;
-            return;
+            cerr << "> Cannot explain statement #" << id << ": " << sqlite3_errmsg(db) << endl;
+            numScans++;
+            continue;
+        }
+
+        // Each row is a step of the plan: (id, parent, notused, detail). Indexed steps are "SEARCH ..."
+        while (cursor.next())
+        {
+            string_view detail = cursor.getText(3);
+            if (detail.substr(0, 5) == "SCAN ")
+            {
+                cerr << "! Statement #" << id << " doesn't use an index: " << detail << endl;
+                numScans++;
+            }
         }
+    }
+
+    if (numScans == 0)
+        cerr << "> Query plans: all " << sizeof(STMT_LOOKUPS) / sizeof(STMT_LOOKUPS[0]) << " lookups use indexes" << endl;
+
+    return numScans;
+}
+
+void CygpmDatabase::clearStatementBindings()
+{
+    for (auto stmt : statements)
+    {
+        if (stmt == NULL)
+            continue;
 
-        // Reset statement for the next execution
-        // If not reset, SQLite will always use the previous values.
         sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+}
 
-        /* Get the next remainder */
-        token = strtok(NULL, splitter);
+int CygpmDatabase::applyProfile(DatabaseProfile newProfile)
+{
+    if (openMode != DB_OPEN_READ_WRITE)
+    {
+        cerr << "> Cannot apply " << PROFILE_NAMES[newProfile] << " profile: Database is read-only" << endl;
+        return SQLITE_READONLY;
     }
 
-    /**
-     * Finalize (clean up) the statement
-     */
-    sqlite3_finalize(stmt);
+    rc = sqlite3_exec(db, PROFILE_SQL[newProfile], NULL, 0, &zErrMsg);
+    if (rc != SQLITE_OK)
+    {
+        cerr << "> Cannot apply " << PROFILE_NAMES[newProfile] << " profile: " << zErrMsg << endl;
+
+        SQLITE_ERR_RETURN;
+    }
+
+    /* Merge what the build wrote into the database file, so that the WAL doesn't stay large,
+       and DB_OPEN_IMMUTABLE readers (which ignore it) see the catalog once no one writes */
+    if (newProfile == DB_PROFILE_SERVING && profile != DB_PROFILE_SERVING)
+        sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE);", NULL, 0, NULL);
+
+    profile = newProfile;
+    cerr << "> Database profile: " << PROFILE_NAMES[profile] << endl;
+
+    return SQLITE_OK;
 }
 
 int CygpmDatabase::initTransaction()
@@ -799,6 +1267,8 @@ int CygpmDatabase::initTransaction()
         SQLITE_ERR_RETURN;
     }
 
+    nameIds.clear(); // IDs added by a rolled back transaction are gone
+
     errorLevel = 0;
     return errorLevel;
 }
@@ -836,6 +1306,26 @@ void CygpmDatabase::execTransactionSQL(const char *sql_statement)
     }
 }
 
+void CygpmDatabase::setParseMode(ParseMode mode)
+{
+    parseMode = mode;
+}
+
+void CygpmDatabase::setResolverMode(ResolverMode mode)
+{
+    resolverMode = mode;
+}
+
+void CygpmDatabase::setParseThreads(int numThreads)
+{
+    parseThreads = numThreads;
+}
+
+void CygpmDatabase::setIncrementalBuild(bool on)
+{
+    incrementalBuild = on;
+}
+
 int CygpmDatabase::getErrorLevel()
 {
     return errorLevel;
@@ -851,42 +1341,25 @@ const char *CygpmDatabase::getErrorMsg()
     return sqlite3_errmsg(db);
 }
 
-int CygpmDatabase::getNumPackages()
+const BuildPipelineStats &CygpmDatabase::getPipelineStats()
 {
-    /* Variables */
-    char **dbResult; // Results from sqlite3_get_table()
-    int nRow;        // Row count
-    int nColumn;     // Column count
-    int i, j;        // Loop variable
-
-    /**
-     * NOTICE: In sqlite3_get_table(), dbResult's column values are successive. 
-     * It stores the dimension table (traditional RxC) into a flat array.
-     * So, dbResult[0, nColumn - 1] are column names, dbResult[nColumn, len(dbResult)] are column values.
-     */
-    int nIndex; // Current index of dbResult
+    return pipelineStats;
+}
 
-    /* SQL query */
-    const char *SQL_GET_NUM_PACKAGES = R"(
-        SELECT COUNT(PKG_NAME) FROM PKG_INFO;
-    )";
+int CygpmDatabase::getNumPackages()
+{
+    int numPackages = 0;
 
-    /**
-     * Execute SQL statement to get package count
-     */
-    rc = sqlite3_get_table(db, SQL_GET_NUM_PACKAGES, &dbResult, &nRow, &nColumn, &zErrMsg);
-    if (rc != SQLITE_OK)
+    sqlite3_stmt *stmt = getStatement(STMT_COUNT_PACKAGES);
+    if (stmt == NULL)
     {
-        cerr << "SQL error: " << zErrMsg << endl;
-
-        SQLITE_ERR_RETURN;
+        errorLevel = sqlite3_errcode(db);
+        return errorLevel;
     }
 
-    /**
-     * Start parsing query result.
-     * Result is also a SQL table, but only one column, one line.
-     */
-    nIndex = nColumn; // Initialize nIndex
+    StatementCursor cursor(stmt);
+    if (cursor.next())
+        numPackages = cursor.getInt(0);
 
-    return atoi(dbResult[nIndex]);
+    return numPackages;
 }
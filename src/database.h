@@ -6,6 +6,13 @@
 #include "lex.export.h"
 #include "tokens.h"
 #include "utils.h"
+#include "setupini_input.h"
+#include "arena.h"
+#include "spsc_queue.h"
+#include "dep_graph.h"
+#include "statement_cursor.h"
+#include "installed_db.h"
+#include "cygwin_version.h"
 
 using namespace std;
 
@@ -23,31 +30,309 @@ using namespace std;
                                                                                                  // @param5: a destructor used to dispose of the BLOB or string                                      \
                                                                                                  //          when SQLite finishes with it. Use SQLITE_STATIC here.
 
+/**
+ * Bind a string_view without copying. data() can be NULL (an empty field), so bind "" instead to keep it non-NULL.
+ */
+#define SQLITE_BIND_MY_COLUMN_VIEW(zName, view) \
+    sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, zName), view.data() ? view.data() : "", view.length(), SQLITE_STATIC);
+
 #define STR_EQUAL(x, y) strcmp(x, y) == 0
-#define YAML_SECTION_IS(x) YAML_section.compare(x) == 0
 
-struct CurrentPackageInfo
+/**
+ * Parsed package records.
+ * In PARSE_MODE_MMAP, every field is a slice of the mapped setup.ini, so no field is copied
+ * until it's bound to a SQLite statement. In PARSE_MODE_STREAM, fields live in a BuildArena.
+ */
+struct PackageInfoView
+{
+    string_view pkg_name; // Without the leading "@ "
+    string_view sdesc;
+    string_view ldesc;
+    string_view category;
+    string_view requires__raw;
+    string_view version;
+    string_view install__raw;
+    string_view source__raw;
+    string_view depends2__raw;
+    string_view obsoletes__raw;
+    string_view provides__raw;
+    string_view conflicts__raw;
+
+    uint64_t block_hash = 0; // Fingerprint of the whole "@ package" block, including its previous versions
+};
+
+struct PrevPackageInfoView
+{
+    string_view pkg_name;
+    string_view version;
+    string_view install__raw;
+    string_view source__raw;
+    string_view depends2__raw;
+};
+
+/**
+ * A slice of setup.ini in memory, with records parsed from it (see db_build_mmap.cpp).
+ */
+struct SetupIniShard
+{
+    char *base = NULL; // Shard start
+    size_t size = 0;   // Shard size, including two trailing '\0's required by yy_scan_buffer()
+
+    BuildArena arena;                             // Owns the lists below. Freed with the shard
+    ArenaList<PackageInfoView> packages;          // Parsed packages
+    ArenaList<PrevPackageInfoView> prev_versions; // Parsed previous versions
+    SetupIniHeader header;                        // setup.ini's header. Only the first shard has one
+    bool failed = false;                          // Shard couldn't be parsed
+};
+
+void parseShard(SetupIniShard &shard); // Parse a shard in place. Its last two bytes must be '\0'
+
+/**
+ * Finds package lines ("@ ...") where a new package block can start, scanning setup.ini once from its start.
+ * A package line must follow a blank line (or start the file), and must not be inside a quoted string,
+ * as an ldesc can hold blank lines and "@ " of its own. Strings are told from words as the lexer tells them:
+ * a quote opens a string only where a token starts and only if a closing quote follows, so a quote inside
+ * a word (it"s) or in a comment line opens nothing.
+ */
+class PackageBoundaryScanner
+{
+private:
+    const char *data;
+    size_t size;
+    size_t pos = 0;              // Scanned up to here. Always where a token can start
+    bool unclosed_quote = false; // No closing quote is left after pos
+
+public:
+    PackageBoundaryScanner(const char *data, size_t size);
+
+    size_t next(size_t from); // First package line at or after from, which must not go backwards. size if there's none
+};
+
+/**
+ * A batch of packages passed from the parser thread to the inserter in PARSE_MODE_STREAM.
+ * Batches are slots of an SPSCQueue, so their arenas are reused batch after batch.
+ */
+struct PackageBatch
+{
+    BuildArena arena;                             // Owns field text & the lists below. Reset when the slot is reused
+    ArenaList<PackageInfoView> packages;
+    ArenaList<PrevPackageInfoView> prev_versions;
+};
+
+/**
+ * Stage timings of the last PARSE_MODE_STREAM build, see getPipelineStats().
+ * A stage that waits a lot is not the bottleneck: If the parser waits for free slots, inserting limits
+ * the build. If the inserter waits for batches, parsing (or reading setup.ini) does.
+ */
+struct BuildPipelineStats
+{
+    size_t numBatches = 0;
+    size_t queueCapacity = 0;   // In batches
+    double meanQueueDepth = 0;  // Batches ready (including the one taken), sampled each time the inserter takes one
+    size_t maxQueueDepth = 0;
+    double parseMs = 0;         // Parser thread, from start to its last batch
+    double parseWaitMs = 0;     // Of parseMs, time waiting for a free slot
+    double insertMs = 0;        // Inserter, from start to its last batch
+    double insertWaitMs = 0;    // Of insertMs, time waiting for a batch
+};
+
+/**
+ * Dispatch tables from YAML key IDs to the fields they're stored to. NULL (or -1) if we don't store the key.
+ * Built at compile time, so dispatching a key is a single lookup.
+ */
+struct YAMLFieldTable
+{
+    string_view PackageInfoView::*package[NUM_YAML_KEYS];
+    string_view PrevPackageInfoView::*prev_version[NUM_YAML_KEYS];
+    int header[NUM_YAML_KEYS]; // SetupIniHeaderField
+};
+
+constexpr YAMLFieldTable makeYAMLFieldTable()
+{
+    YAMLFieldTable table = {};
+
+    table.package[YAML_KEY_SDESC] = &PackageInfoView::sdesc;
+    table.package[YAML_KEY_LDESC] = &PackageInfoView::ldesc;
+    table.package[YAML_KEY_CATEGORY] = &PackageInfoView::category;
+    table.package[YAML_KEY_REQUIRES] = &PackageInfoView::requires__raw;
+    table.package[YAML_KEY_VERSION] = &PackageInfoView::version;
+    table.package[YAML_KEY_INSTALL] = &PackageInfoView::install__raw;
+    table.package[YAML_KEY_SOURCE] = &PackageInfoView::source__raw;
+    table.package[YAML_KEY_DEPENDS2] = &PackageInfoView::depends2__raw;
+    table.package[YAML_KEY_OBSOLETES] = &PackageInfoView::obsoletes__raw;
+    table.package[YAML_KEY_PROVIDES] = &PackageInfoView::provides__raw;
+    table.package[YAML_KEY_CONFLICTS] = &PackageInfoView::conflicts__raw;
+
+    table.prev_version[YAML_KEY_VERSION] = &PrevPackageInfoView::version;
+    table.prev_version[YAML_KEY_INSTALL] = &PrevPackageInfoView::install__raw;
+    table.prev_version[YAML_KEY_SOURCE] = &PrevPackageInfoView::source__raw;
+    table.prev_version[YAML_KEY_DEPENDS2] = &PrevPackageInfoView::depends2__raw;
+
+    for (int i = 0; i < NUM_YAML_KEYS; i++)
+        table.header[i] = -1;
+    table.header[YAML_KEY_RELEASE] = HEADER_RELEASE;
+    table.header[YAML_KEY_ARCH] = HEADER_ARCH;
+    table.header[YAML_KEY_SETUP_TIMESTAMP] = HEADER_SETUP_TIMESTAMP;
+    table.header[YAML_KEY_SETUP_MINIMUM_VERSION] = HEADER_SETUP_MINIMUM_VERSION;
+    table.header[YAML_KEY_SETUP_VERSION] = HEADER_SETUP_VERSION;
+
+    return table;
+}
+
+constexpr YAMLFieldTable YAML_FIELDS = makeYAMLFieldTable();
+
+inline string_view *selectYAMLField(YAMLKeyId key_id, PackageInfoView &pkg_info)
+{
+    string_view PackageInfoView::*field = YAML_FIELDS.package[key_id];
+    return field != NULL ? &(pkg_info.*field) : NULL;
+}
+
+inline string_view *selectYAMLField_PrevVersion(YAMLKeyId key_id, PrevPackageInfoView &prev_pkg_info)
+{
+    string_view PrevPackageInfoView::*field = YAML_FIELDS.prev_version[key_id];
+    return field != NULL ? &(prev_pkg_info.*field) : NULL;
+}
+
+inline string *selectHeaderField(YAMLKeyId key_id, SetupIniHeader &header)
+{
+    int field = YAML_FIELDS.header[key_id];
+    return field >= 0 ? &header.fields[field] : NULL;
+}
+
+enum ParseMode
 {
+    PARSE_MODE_STREAM = 0, // Read setup.ini via stdio, copying every token into an arena (default).
+                           // Parses on its own thread, inserting on the calling one
+    PARSE_MODE_MMAP,       // Map setup.ini into memory, keeping fields as slices of the mapping
+    PARSE_MODE_PARALLEL    // Same as PARSE_MODE_MMAP, but split setup.ini into shards, parsing them on multiple threads
+};
+
+enum ResolverMode
+{
+    RESOLVER_MODE_WALK = 0, // Walk dependencies package by package, one query each (default).
+                            // findDependents() & findOrphans() walk the in-memory dependency graph instead
+    RESOLVER_MODE_CTE       // Resolve the whole closure in a single WITH RECURSIVE query.
+                            // findDependencies() lists it in the same order as the walk
+};
+
+enum DatabaseProfile
+{
+    DB_PROFILE_SERVING = 0, // Safe settings for queries & small updates (default)
+    DB_PROFILE_BULK_BUILD   // Fast, non-durable settings for rebuilding the whole catalog
+};
+
+/**
+ * How a CygpmDatabase opens its file.
+ * Catalogs are kept in WAL mode by both profiles, so readers are never blocked by a writer (even one
+ * rebuilding the catalog), and they don't block it either: Each reader sees the catalog as of its last commit.
+ * Builds, incremental or full, commit once. So readers see either the old or the new catalog, nothing in between.
+ */
+enum DatabaseOpenMode
+{
+    DB_OPEN_READ_WRITE = 0, // Build & query (default)
+    DB_OPEN_READ_ONLY,      // Query only, with the file memory-mapped. Many processes can share it with one writer
+    DB_OPEN_IMMUTABLE       // Like DB_OPEN_READ_ONLY, but without any locking. Only for a file nobody writes while it's open,
+                            // such as a published copy: Changes (and an unmerged WAL) are not seen, or seen half-done
+};
+
+/**
+ * Statements registered in CygpmDatabase. Each is prepared once per connection, then reused.
+ */
+enum StatementId
+{
+    STMT_INSERT_NAME = 0,
+    STMT_GET_NAME_ID,
+    STMT_INSERT_PACKAGE_INFO,
+    STMT_INSERT_VERSION, // Current & previous versions
+    STMT_INSERT_DEPENDENCY,
+    STMT_DELETE_PACKAGE_INFO,
+    STMT_DELETE_VERSIONS,
+    STMT_DELETE_DEPENDENCIES,
+    STMT_REPLACE_METADATA,
+    STMT_GET_PACKAGE,       // Current version's columns, see PackageColumn
+    STMT_GET_PREV_VERSION,  // A previous version's columns, laid out as STMT_GET_PACKAGE
+    STMT_GET_PREV_VERSIONS, // Version list of previous versions
+    STMT_GET_NEWEST_VERSION,      // Highest version by VERSION_KEY
+    STMT_GET_VERSIONS_IN_RANGE,   // Versions whose keys are in a range, in version order
+    STMT_GET_DEPENDENCIES,         // Dependencies of a given version, as (NAME, ID)
+    STMT_GET_CURRENT_DEPENDENCIES, // Dependencies of current version, as (NAME, ID)
+    STMT_GET_DEPENDENCIES_BY_ID,   // Dependencies of current version, looked up by package ID
+    STMT_RESOLVE_DEPENDENCIES,     // Dependencies of every package in a package's transitive closure, as (package ID, ID, NAME)
+    STMT_RESOLVE_DEPENDENTS,       // Transitive closure of packages depending on a package
+    STMT_FIND_ORPHANS,             // Installed packages no manually installed one needs
+    STMT_GET_PACKAGE_RECORDS,      // Columns of many packages at once, see PackageRecord
+    STMT_SEARCH_PACKAGES,          // Ranked full-text search
+    STMT_SEARCH_TRIGRAMS,          // Packages whose text is LIKE a pattern
+    STMT_COUNT_PACKAGES,
+    NUM_STATEMENTS
+};
+
+/**
+ * Result columns of STMT_GET_PACKAGE & STMT_GET_PREV_VERSION
+ */
+enum PackageColumn
+{
+    PKG_COL_VERSION = 0,
+    PKG_COL_SDESC,    // SDESC, LDESC & CATEGORY are NULL for previous versions
+    PKG_COL_LDESC,
+    PKG_COL_CATEGORY,
+    PKG_COL_INSTALL_PAK_PATH,
+    PKG_COL_INSTALL_PAK_SIZE,
+    PKG_COL_INSTALL_PAK_SHA512,
+    PKG_COL_SOURCE_PAK_PATH,
+    PKG_COL_SOURCE_PAK_SIZE,
+    PKG_COL_SOURCE_PAK_SHA512
+};
+
+/**
+ * A package's columns, as returned by getPackageRecords()
+ */
+struct PackageRecord
+{
+    struct Pak
+    {
+        string path;
+        sqlite3_int64 size = -1; // -1 if unknown
+        string sha512;           // Hex digest
+    };
+
     string pkg_name;
-    string sdesc;
+    bool found = false; // false if there's no such package (or version, current or previous). Other fields are left empty
+    string version;
+    string sdesc;       // Package-wide fields. Also filled for previous versions
     string ldesc;
     string category;
-    string requires__raw;
-    string version;
-    string install__raw;
-    string source__raw;
-    string depends2__raw;
+    Pak install;
+    Pak source;
 };
 
-struct CurrentPrevPackageInfo
+/**
+ * A hit of searchPackages()
+ */
+struct SearchResult
 {
     string pkg_name;
-    string version;
-    string install__raw;
-    string source__raw;
-    string depends2__raw;
+    string sdesc;
+    string snippet; // Best matching fragment of name or descriptions, keywords marked as [keyword]
+    double rank;    // BM25 score. Lower is better
 };
 
+/**
+ * Catalog schema version, stored as PRAGMA user_version.
+ * 0: Denormalized text tables (PKG_INFO, PREV_VERSIONS & DEPENDENCY_MAP), migrated on open.
+ * 2: Normalized tables with integer keys (PACKAGE_NAMES, PACKAGES, VERSIONS & DEPENDENCIES), see db_schema.cpp.
+ * 3: Adds full-text search tables (PACKAGE_SEARCH & PACKAGE_TRIGRAMS), migrated on open.
+ * 4: Adds VERSIONS.VERSION_KEY, sortable keys of versions (see cygwin_version.h), migrated on open.
+ */
+#define CATALOG_SCHEMA_VERSION 4
+
+/**
+ * A setup.ini database.
+ *
+ * Thread safety: An object must be used by one thread at a time. Different objects
+ * (each with its own database file and setup.ini) can build & query concurrently,
+ * as the lexer keeps no global state: Every parse owns its scanners.
+ */
 class CygpmDatabase
 {
 private:
@@ -58,18 +343,47 @@ private:
     int errorLevel = 0; // Error state. Only for constructors (or fallback).
                         // Other non-constructors can directly return error code.
 
+    DatabaseProfile profile = DB_PROFILE_SERVING; // PRAGMAs currently in effect
+    DatabaseOpenMode openMode = DB_OPEN_READ_WRITE;
+    ParseMode parseMode = PARSE_MODE_STREAM;      // How to read setup.ini
+    ResolverMode resolverMode = RESOLVER_MODE_WALK; // How findDependencies(), findDependents() & findOrphans() resolve
+    int parseThreads = 0;                    // Thread count of PARSE_MODE_PARALLEL. 0 means one per CPU core
+    bool incrementalBuild = false;           // Only update packages whose block changed, instead of rebuilding all
+    bool fullRebuild = false;                // createTable() has begun a full rebuild's transaction, committed by parseAndBuildDatabase()
+    BuildPipelineStats pipelineStats;        // Of the last PARSE_MODE_STREAM build
+
+    sqlite3_stmt *statements[NUM_STATEMENTS] = {}; // Statement registry. Prepared on first use, finalized by destructor
+    unordered_map<string, sqlite3_int64> nameIds;  // Cache of PACKAGE_NAMES. Cleared on each transaction
+    string versionKey;                             // Scratch of insertVersion(), reused so keys are built without allocating
+    DependencyGraph dependencyGraph;               // CSR graph of dependencies. Empty until built or loaded
+
 public:
-    CygpmDatabase(const char *fileName);
+    CygpmDatabase(const char *fileName, DatabaseOpenMode mode = DB_OPEN_READ_WRITE);
     ~CygpmDatabase();
-    void open(const char *fileName); // Manually open database
+    void open(const char *fileName, DatabaseOpenMode mode = DB_OPEN_READ_WRITE); // Manually open database
+
+    int createTable();                                        // Create basic table. A full rebuild is committed by parseAndBuildDatabase()
+    int parseAndBuildDatabase(const char *setupini_fileName); // Parse setup.ini, adding its data into database. Rolled back on failure
+    int buildDependencyMap();                                 // Build dependency graph. The map itself is filled by parseAndBuildDatabase()
+    bool isUpToDate(const char *setupini_fileName);           // Check if setup.ini's header equals the one database was built from
+    int applyProfile(DatabaseProfile newProfile);             // Apply a set of PRAGMAs. Must be called out of transactions
+    int createIndexes();                                      // Create secondary indexes. Call it after data is loaded
+    int checkQueryPlans();                                    // Check that lookups use indexes. Returns count of lookups scanning a table
 
-    int createTable();                                        // Create basic table
-    int parseAndBuildDatabase(const char *setupini_fileName); // Parse setup.ini, adding its data into database
-    int buildDependencyMap();                                 // Parse dependency list, then build dependency map
+    int findDependencies(vector<string> &dependency_list, const char *pkg_name, const char *version); // Find dependencies, depth-first, after the package itself
+    int findDependents(vector<string> &dependent_list, const char *pkg_name);                          // Find packages depending on it, directly or not
+    int findOrphans(const vector<InstalledPackage> &installed, vector<string> &orphans);              // Find installed packages not needed by manually installed ones
 
-    int findDependencies(vector<string> &dependency_list, const char *pkg_name, const char *version); // Find dependencies
+    const DependencyGraph &getDependencyGraph();          // Graph of current versions. Built by buildDependencyMap(), or on first use
+    int saveDependencyGraph(const char *graph_fileName); // Save graph into a sidecar file
+    int loadDependencyGraph(const char *graph_fileName); // Map graph from a sidecar file. CPM_INDEX_OUTDATED if it's not built from current catalog
+    int saveCatalogCache(const char *cache_fileName);    // Compile current versions into a cache file, read by CatalogCache without SQLite. Best after createIndexes()
 
-    char *getNewestVersion(const char *pkg_name);
+    /** 
+     * Package queries. char * results are allocated by malloc(), free() them after use.
+     * NULL if there's no such package (or version).
+     */
+    char *getNewestVersion(const char *pkg_name); // Highest of current & previous versions, see compareVersions(). Usually the current one
     char *getShortDesc(const char *pkg_name);
     char *getLongDesc(const char *pkg_name);
     char *getCategory(const char *pkg_name);
@@ -79,12 +393,33 @@ public:
     char *getSourcePakPath(const char *pkg_name, const char *version);
     char *getSourcePakSize(const char *pkg_name, const char *version);
     char *getSourcePakSHA512(const char *pkg_name, const char *version);
-    vector<const char *> getPrevVersions(const char *pkg_name);
+    vector<string> getPrevVersions(const char *pkg_name); // Owned strings, in version order
+    vector<string> getVersionsInRange(const char *pkg_name, const char *min_version, const char *max_version); // All versions within [min, max], in version order.
+                                                                                                               // NULL leaves that end open. A bound without release
+                                                                                                               // (4.4.12) is older than its releases (4.4.12-1)
+    int getPackageRecords(const vector<string> &pkg_names, const char *version, vector<PackageRecord> &records); // All columns of packages in one query.
+                                                                                                                 // One record per name, in the same order.
+                                                                                                                 // version selects any stored version, current
+                                                                                                                 // or previous. Unlike the getters, which only
+                                                                                                                 // take previous ones. NULL for the current one
+
+    /**
+     * Package search over names & descriptions (see db_search.cpp). Matching is case-insensitive.
+     */
+    int searchPackages(const char *keywords, int limit, vector<SearchResult> &results); // Packages having all keywords (as word prefixes), best first
+    int searchPackagesBySubstring(const char *text, vector<string> &pkg_names);        // Packages containing text anywhere, in name order
+    int searchPackagesByRegex(const char *pattern, vector<string> &pkg_names);         // Packages matching an ECMAScript regex, in name order
+
+    void setParseMode(ParseMode mode);   // Select how parseAndBuildDatabase() reads setup.ini
+    void setResolverMode(ResolverMode mode); // Select how findDependencies(), findDependents() & findOrphans() resolve
+    void setParseThreads(int numThreads); // Set thread count for PARSE_MODE_PARALLEL
+    void setIncrementalBuild(bool on);    // Keep existing tables, only upsert/delete changed packages
 
     int getErrorLevel();
     int getErrorCode();
     const char *getErrorMsg();
     int getNumPackages();
+    const BuildPipelineStats &getPipelineStats(); // Queue depth & stage timings of the last PARSE_MODE_STREAM build
 
     /** TODO:
      * - Querying database
@@ -92,16 +427,38 @@ public:
      */
 
 private:
-    void insertPackageInfo(CurrentPackageInfo *packageInfo);
-    void insertPrevPackageInfo(CurrentPrevPackageInfo *prevPackageInfo);
-    inline void submitYAMLItem(string YAML_section, CurrentPackageInfo *pkg_info, stringstream &buff);
-    inline void submitYAMLItem_PrevVersion(string YAML_section, CurrentPrevPackageInfo *prev_pkg_info, stringstream &buff);
-    inline void parseRequiresRaw(char *pkg_name, char *version, char *requires__raw);
-    inline void parseDepends2(char *pkg_name, char *version, char *depends2__raw);
+    int parseAndBuildDatabase_Stream(const char *setupini_fileName);                // PARSE_MODE_STREAM
+    int parseAndBuildDatabase_Mapped(const char *setupini_fileName, int numShards); // PARSE_MODE_MMAP & PARSE_MODE_PARALLEL
+    int findDependencies_CTE(vector<string> &dependency_list, const char *pkg_name, const char *version); // RESOLVER_MODE_CTE
+    int findDependents_CTE(vector<string> &dependent_list, const char *pkg_name);                        // Ditto
+    int findOrphans_CTE(const vector<InstalledPackage> &installed, vector<string> &orphans);            // Ditto
+    int walkDependencies(vector<string> &dependency_list, const char *pkg_name,
+                         function<int(sqlite3_int64 package_id, vector<pair<sqlite3_int64, string>> &dependencies)> expand); // List dependencies in walk order
+    int queryDependencies(sqlite3_stmt *stmt, vector<pair<sqlite3_int64, string>> &dependencies);        // Step a bound STMT_GET_*DEPENDENCIES*
+    int scanSearchCandidates(const string &literal, function<void(const char **columns)> visit);        // Rows of (NAME, SDESC, LDESC) which may contain literal
+    sqlite3_int64 insertPackageInfo(const PackageInfoView &packageInfo);             // Inserts the version & its dependencies. Returns ID of the version. 0 on error
+    sqlite3_int64 insertPrevPackageInfo(const PrevPackageInfoView &prevPackageInfo); // Ditto
+    sqlite3_int64 insertVersion(sqlite3_int64 package_id, string_view version, bool is_current, string_view requires__raw,
+                                string_view depends2__raw, string_view install__raw, string_view source__raw);
+    sqlite3_int64 getNameId(string_view pkg_name); // Get ID of a package name, adding it if it's new. 0 on error
+    void mergeShardsIncrementally(vector<SetupIniShard> &shards);
+    void insertDependencies(sqlite3_int64 version_id, string_view dependencies__raw, char splitter);
+    void deletePackageRows(string_view pkg_name);
+    int buildDependencyGraph();
+    uint64_t getCatalogStamp(); // Fingerprint of stored setup.ini header
+    void storeMetadata(const SetupIniHeader &header);
+    bool loadMetadata(SetupIniHeader &header);
+    int getSchemaVersion();
+    bool hasCurrentSchema();
+    int updateSearchIndex(); // Fill search tables created by createTable(), then keep them in sync by triggers
+    int migrateSchema(); // Convert tables of older schema versions, see CATALOG_SCHEMA_VERSION
+    void registerVersionFunctions(); // Collation CYGWIN_VERSION & SQL function cygpm_version_key()
     int initTransaction();
     int commitTransaction();
     void execTransactionSQL(const char *sql_statement);
-    inline char *queryOneResult(const char *sql_statement);
+    sqlite3_stmt *getStatement(StatementId id); // Get a registered statement, ready to bind. NULL if it can't be prepared
+    void clearStatementBindings();               // Drop all bindings, so no statement refers to freed memory
+    char *queryPackageColumn(const char *pkg_name, const char *version, PackageColumn column);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,471 @@
+#include "database.h"
+
+/**
+ * Zero-copy setup.ini parser (PARSE_MODE_MMAP & PARSE_MODE_PARALLEL).
+ *
+ * setup.ini is mapped into memory and scanned in place by yy_scan_buffer(),
+ * so yytext always points into the mapping. Each YAML item is recorded as a
+ * string_view covering its first to last token, which stays valid until the
+ * file is unmapped. Words are joined by a single space, as in stream mode, so an item
+ * whose words are separated otherwise (tabs, line breaks...) is copied into the shard's arena.
+ * No token is copied to the heap.
+ *
+ * In parallel mode, the mapping is split into shards at "@ " package boundaries.
+ * Each shard is parsed by its own reentrant scanner on its own thread, then
+ * the main thread inserts all shards' records in file order.
+ */
+
+/**
+ * Extend a field to cover the current token, joined by a single space.
+ * Words of one YAML item are usually that way in the mapping, so we only need to move the end.
+ * Otherwise, they're joined in the arena.
+ */
+static inline void extendYAMLField(BuildArena &arena, string_view &field, const char *token, int token_length)
+{
+    if (field.data() == NULL)
+        field = string_view(token, token_length);
+    else if (token == field.data() + field.length() + 1 && token[-1] == ' ')
+        field = string_view(field.data(), field.length() + 1 + token_length);
+    else
+        field = arena.append(field, token, token_length, ' ');
+}
+
+PackageBoundaryScanner::PackageBoundaryScanner(const char *data, size_t size) : data(data), size(size)
+{
+}
+
+static bool isTokenSeparator(char c) // Characters WORD can't hold
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\a';
+}
+
+size_t PackageBoundaryScanner::next(size_t from)
+{
+    while (pos < size) // pos is always where a token can start
+    {
+        if (isTokenSeparator(data[pos]))
+        {
+            pos++;
+            continue;
+        }
+
+        bool line_start = pos == 0 || data[pos - 1] == '\n';
+        if (data[pos] == '#' && line_start) // A comment's quotes don't count. Skip to its line break
+        {
+            const char *line_end = (const char *)memchr(data + pos, '\n', size - pos);
+            pos = line_end == NULL ? size : line_end - data;
+            continue;
+        }
+
+        if (data[pos] == '@' && line_start && pos >= from && pos + 1 < size && data[pos + 1] == ' ' &&
+            (pos == 0 || (pos >= 2 && isspace((unsigned char)data[pos - 2]))))
+            return pos++;
+
+        size_t word_end = pos;
+        while (word_end < size && !isTokenSeparator(data[word_end]))
+            word_end++;
+
+        // A quote opens a string only if it's closed later, and the string is no shorter than the WORD
+        // starting at the same quote, as the lexer takes the longest match (the string's rule wins ties)
+        if (data[pos] == '"' && !unclosed_quote)
+        {
+            const char *quote = (const char *)memchr(data + pos + 1, '"', size - pos - 1);
+            if (quote == NULL)
+                unclosed_quote = true; // No quote at all from here on, don't look again
+            else if ((size_t)(quote - data) + 1 >= word_end)
+            {
+                pos = quote - data + 1; // The next token can start right after the string
+                continue;
+            }
+        }
+
+        pos = word_end;
+    }
+
+    return size;
+}
+
+/**
+ * Split the mapped setup.ini into at most numShards shards.
+ *
+ * A shard (except the last one) ends right before a package line found by PackageBoundaryScanner,
+ * whose preceding two bytes are blank (usually "\n\n", or "\r\n" in a CRLF file).
+ * Those two bytes are overwritten by '\0's so the shard can be scanned in place.
+ * The last shard ends with the two '\0's appended by mapFileForScan().
+ */
+static vector<SetupIniShard> splitIntoShards(MappedFile &setupini, int numShards)
+{
+    vector<SetupIniShard> shards;
+    char *data = setupini.data;
+    size_t shard_start = 0;
+    PackageBoundaryScanner boundaries(data, setupini.size);
+
+    for (int i = 1; i < numShards; i++)
+    {
+        size_t boundary = boundaries.next(max(setupini.size * i / numShards, shard_start + 2));
+        if (boundary == setupini.size)
+            break; // No more boundaries. Let the last shard take the remainder
+
+        data[boundary - 2] = '\0';
+        data[boundary - 1] = '\0';
+        shards.emplace_back();
+        shards.back().base = data + shard_start;
+        shards.back().size = boundary - shard_start;
+
+        shard_start = boundary;
+    }
+
+    shards.emplace_back();
+    shards.back().base = data + shard_start;
+    shards.back().size = setupini.size + 2 - shard_start;
+
+    return shards;
+}
+
+/**
+ * Parse one shard with its own scanner.
+ * Touches nothing but the shard itself, so shards can be parsed simultaneously.
+ */
+void parseShard(SetupIniShard &shard)
+{
+    int token_type;   // Lexer token type
+    yyscan_t scanner; // Lexer object, owned by this shard
+
+    /**
+     * Operation bits - controlling the switch cases' behaviour
+     */
+    bool is_adding_a_package = false;          // I'm manipulating a package's info
+    bool is_adding_a_previous_version = false; // I'm manipulating a package's previous versions ("[prev]")
+
+    /**
+     * Buffer objects
+     */
+    PackageInfoView pkg_info;          // Current package's info
+    PrevPackageInfoView prev_pkg_info; // Current package's previous version info
+    string_view *current_field = NULL; // The field collecting tokens. NULL if current YAML item is not stored
+    string *header_field = NULL;       // The header field collecting tokens
+    const char *block_start = NULL;    // Where current package's block starts ("@ ...")
+    const char *block_end = NULL;      // End of the last meaningful token in current package's block
+
+    if (yylex_init(&scanner) != 0)
+    {
+        cerr << "Parse error: Failed to create lexer for a shard" << endl;
+        shard.failed = true;
+        return;
+    }
+
+    YY_BUFFER_STATE scan_buffer = yy_scan_buffer(shard.base, shard.size, scanner);
+    if (scan_buffer == NULL)
+    {
+        cerr << "Parse error: Lexer refused a shard" << endl;
+        yylex_destroy(scanner);
+        shard.failed = true;
+        return;
+    }
+
+    // Call lexer
+    while (token_type = yylex(scanner))
+    {
+        YAMLKeyId key_id = YAML_KEY_UNKNOWN; // Which key a T_YAML_Key is
+        if (token_type >= T_YAML_Key)
+        {
+            key_id = YAML_KEY_ID(token_type);
+            token_type = T_YAML_Key;
+        }
+
+        char *yytext = yyget_text(scanner); // Current matched text
+        int yyleng = yyget_leng(scanner);   // Its length
+
+        switch (token_type)
+        {
+        case T_Package_Name:
+            /**
+             * Submit the last package (and its last previous version) before starting a new one.
+             * Fields are already in place, no need to commit the last YAML item.
+             */
+            if (is_adding_a_package)
+            {
+                pkg_info.block_hash = fnv1a64(block_start, block_end - block_start);
+                shard.packages.push_back(shard.arena, pkg_info);
+
+                if (is_adding_a_previous_version)
+                    shard.prev_versions.push_back(shard.arena, prev_pkg_info);
+            }
+
+            /**
+             * Start handling a new package.
+             */
+            pkg_info = PackageInfoView();
+            pkg_info.pkg_name = string_view(yytext + 2, yyleng - 2); // Skip "@ "
+            block_start = yytext;
+
+            is_adding_a_package = true;
+            is_adding_a_previous_version = false;
+            current_field = NULL;
+            header_field = NULL;
+
+            break;
+
+        case T_YAML_Key:
+            // Items before the first package are setup.ini's header
+            if (!is_adding_a_package)
+            {
+                header_field = selectHeaderField(key_id, shard.header);
+                if (header_field != NULL)
+                    header_field->clear();
+                break;
+            }
+
+            if (is_adding_a_previous_version)
+                current_field = selectYAMLField_PrevVersion(key_id, prev_pkg_info);
+            else
+                current_field = selectYAMLField(key_id, pkg_info);
+
+            if (current_field != NULL)
+                *current_field = string_view(); // A duplicated key overrides the former one
+
+            break;
+
+        case T_Prev_Version_Mark:
+            /**
+             * Check orphan [prev]. This is not allowed.
+             */
+            if (pkg_info.pkg_name.empty())
+            {
+                cerr << "Parse error: Orphan [prev] at " << yyget_lineno(scanner) << endl;
+                break;
+            }
+
+            /**
+             * Submit the last previous version info before getting a new one.
+             */
+            if (is_adding_a_previous_version)
+                shard.prev_versions.push_back(shard.arena, prev_pkg_info);
+
+            /**
+             * Start handling a new previous version.
+             */
+            prev_pkg_info = PrevPackageInfoView();
+            prev_pkg_info.pkg_name = pkg_info.pkg_name;
+
+            is_adding_a_previous_version = true;
+            current_field = NULL;
+
+            break;
+
+        case T_Multiline_String:
+            // A quoted string replaces the item's words, as in stream mode
+            if (current_field != NULL)
+                *current_field = string_view(yytext, yyleng);
+            else if (header_field != NULL)
+                header_field->assign(yytext, yyleng);
+            break;
+
+        case T_Word:
+            if (current_field != NULL)
+                extendYAMLField(shard.arena, *current_field, yytext, yyleng);
+            else if (header_field != NULL)
+            {
+                if (!header_field->empty())
+                    *header_field += ' ';
+                header_field->append(yytext, yyleng);
+            }
+            break;
+        }
+
+        // Whitespaces between blocks are not part of any block
+        if (token_type != T__Ignored)
+            block_end = yytext + yyleng;
+    }
+
+    /**
+     * Remember to add the last package
+     */
+    if (is_adding_a_package)
+    {
+        pkg_info.block_hash = fnv1a64(block_start, block_end - block_start);
+        shard.packages.push_back(shard.arena, pkg_info);
+
+        if (is_adding_a_previous_version)
+            shard.prev_versions.push_back(shard.arena, prev_pkg_info);
+    }
+
+    yy_delete_buffer(scan_buffer, scanner);
+    yylex_destroy(scanner);
+}
+
+/**
+ * Apply parsed shards to existing tables (incremental build).
+ *
+ * A package whose block fingerprint equals the stored BLOCK_HASH is left untouched.
+ * Changed & new packages get their rows (including previous versions and dependency
+ * map) replaced. Packages no longer in setup.ini are deleted.
+ */
+void CygpmDatabase::mergeShardsIncrementally(vector<SetupIniShard> &shards)
+{
+    unordered_map<string, uint64_t> stored_hashes; // Package name -> BLOCK_HASH of current database
+    unordered_set<string_view> changed_packages;   // Packages to be (re)inserted
+    int numUnchanged = 0, numChanged = 0, numAdded = 0, numRemoved = 0;
+
+    /**
+     * Load stored fingerprints. A NULL one (migrated from schema version 0) reads as 0, which no block
+     * hashes to in practice, so those packages count as changed
+     */
+    StatementCursor cursor(db, R"(SELECT N.NAME, P.BLOCK_HASH FROM "PACKAGES" P JOIN "PACKAGE_NAMES" N ON N.ID = P.ID;)");
+    while (cursor.next())
+        stored_hashes[cursor.getString(0)] = (uint64_t)cursor.getInt64(1);
+
+    /**
+     * Upsert current packages
+     */
+    for (auto &shard : shards)
+    {
+        shard.packages.forEach([&](const PackageInfoView &pkg_info) {
+            auto stored = stored_hashes.find(string(pkg_info.pkg_name));
+
+            if (stored == stored_hashes.end())
+                numAdded++;
+            else if (stored->second == pkg_info.block_hash)
+            {
+                numUnchanged++;
+                stored_hashes.erase(stored);
+                return;
+            }
+            else
+            {
+                numChanged++;
+                deletePackageRows(pkg_info.pkg_name);
+                stored_hashes.erase(stored);
+            }
+
+            insertPackageInfo(pkg_info);
+            changed_packages.insert(pkg_info.pkg_name);
+        });
+    }
+
+    for (auto &shard : shards)
+    {
+        shard.prev_versions.forEach([&](const PrevPackageInfoView &prev_pkg_info) {
+            if (changed_packages.count(prev_pkg_info.pkg_name) == 0)
+                return;
+
+            insertPrevPackageInfo(prev_pkg_info);
+        });
+    }
+
+    /**
+     * Whatever left are removed from setup.ini
+     */
+    for (auto &stored : stored_hashes)
+    {
+        deletePackageRows(stored.first);
+        numRemoved++;
+    }
+
+    cerr << "> Incremental build: " << numUnchanged << " unchanged, " << numChanged << " changed, "
+         << numAdded << " added, " << numRemoved << " removed" << endl;
+}
+
+int CygpmDatabase::parseAndBuildDatabase_Mapped(const char *setupini_fileName, int numShards)
+{
+    int numPackages_SetupINI = 0; // Packages' count
+
+    /**
+     * Map setup.ini. If it's compressed, it will be decompressed into memory instead.
+     */
+    MappedFile setupini;
+    int rc_load = loadSetupIniForScan(setupini_fileName, setupini);
+    if (rc_load != CPM_OK)
+    {
+        cerr << "Error while building database: Cannot load " << setupini_fileName << endl;
+        return -rc_load;
+    }
+
+    // Initialize transaction, unless createTable() has begun a full rebuild
+    if (!fullRebuild)
+        initTransaction();
+    if (errorLevel != 0)
+    {
+        cerr << "Error while building database: Transaction starting failed" << endl;
+        unmapFile(setupini);
+        return -errorLevel;
+    }
+
+    /**
+     * Parse shards. The first shard is parsed on the current thread.
+     */
+    vector<SetupIniShard> shards = splitIntoShards(setupini, numShards);
+    vector<thread> workers;
+
+    cerr << "Parsing setup.ini (mapped, " << setupini.size << " bytes, " << shards.size() << " shard(s))" << endl;
+
+    for (size_t i = 1; i < shards.size(); i++)
+        workers.emplace_back(parseShard, ref(shards[i]));
+
+    parseShard(shards[0]);
+
+    for (auto &worker : workers)
+        worker.join();
+
+    for (auto &shard : shards)
+    {
+        if (shard.failed)
+        {
+            cerr << "Error while building database: Failed to parse " << setupini_fileName << endl;
+            sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+            unmapFile(setupini);
+            return -CPM_UNEXPECTED_ERROR;
+        }
+    }
+
+    /**
+     * Merge shards into database in file order.
+     */
+    if (incrementalBuild)
+        mergeShardsIncrementally(shards);
+    else
+    {
+        for (auto &shard : shards)
+        {
+            shard.packages.forEach([&](const PackageInfoView &pkg_info) { insertPackageInfo(pkg_info); });
+            shard.prev_versions.forEach([&](const PrevPackageInfoView &prev_pkg_info) { insertPrevPackageInfo(prev_pkg_info); });
+        }
+    }
+
+    updateSearchIndex();
+    storeMetadata(shards[0].header);
+    if (fullRebuild)
+        createIndexes(); // Committed along with the catalog
+
+    size_t arena_peak = 0, arena_chunks = 0;
+    for (auto &shard : shards)
+    {
+        numPackages_SetupINI += shard.packages.size();
+        arena_peak += shard.arena.getPeakUsedBytes();
+        arena_chunks += shard.arena.getNumChunks();
+    }
+
+    cerr << "> Arena: peak " << (arena_peak + 1023) / 1024 << " KB in " << arena_chunks << " chunk(s)" << endl;
+
+    /**
+     * Release the mapping. All views are invalid from now on.
+     * Statements must not hold any SQLITE_STATIC binding to it, so clear them first.
+     */
+    clearStatementBindings();
+
+    /**
+     * Commit transaction & Get result
+     */
+    errorLevel = commitTransaction();
+    unmapFile(setupini);
+
+    if (errorLevel == 0)
+        cerr << "Built setup.ini database" << endl;
+    else
+    {
+        cerr << "Error while building database: " << zErrMsg << endl;
+        return -errorLevel;
+    }
+
+    return numPackages_SetupINI;
+}
@@ -1,323 +1,600 @@
 #include "database.h"
 
+/**
+ * Append a package name to JSON text, as a quoted string
+ */
+static void appendJsonString(string &json, string_view text)
+{
+    json += '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            json += '\\';
+        if ((unsigned char)c < 0x20) // Not in a package name anyway. Keep JSON valid
+            continue;
+        json += c;
+    }
+    json += '"';
+}
+
 int CygpmDatabase::findDependencies(vector<string> &dependency_list, const char *pkg_name, const char *version = NULL)
 {
+    if (resolverMode == RESOLVER_MODE_CTE)
+        return findDependencies_CTE(dependency_list, pkg_name, version);
+
     /**
-     * Build SQL statement
+     * Query the given package by name & version, then each dependency by ID.
+     * A package not in setup.ini simply has no dependencies.
      */
-    const char *SQL_GET_DEPENDENCIES = R"(
-        SELECT DEPENDS_ON FROM DEPENDENCY_MAP WHERE PKG_NAME = '%s' AND VERSION LIKE '%s';
-    )";
-
-    string s_version(version == NULL ? getNewestVersion(pkg_name) : version);
-    s_version += "%"; // Use wildcard to match possible trailing spaces
-
-    char *query = new char[100 + strlen(SQL_GET_DEPENDENCIES) + strlen(pkg_name) + (version == NULL ? 0 : strlen(version))];
-    sprintf(query, SQL_GET_DEPENDENCIES, pkg_name, s_version.c_str());
+    return walkDependencies(dependency_list, pkg_name, [&](sqlite3_int64 package_id, vector<pair<sqlite3_int64, string>> &dependencies) {
+        sqlite3_stmt *stmt;
+        if (package_id == 0)
+        {
+            stmt = getStatement(version == NULL ? STMT_GET_CURRENT_DEPENDENCIES : STMT_GET_DEPENDENCIES);
+            if (stmt == NULL)
+                return sqlite3_errcode(db);
+
+            SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
+            if (version != NULL)
+            {
+                string_view version_trimmed = rtrimView(version); // Versions are stored trimmed
+                SQLITE_BIND_MY_COLUMN_VIEW(":version", version_trimmed);
+            }
+        }
+        else
+        {
+            stmt = getStatement(STMT_GET_DEPENDENCIES_BY_ID);
+            if (stmt == NULL)
+                return sqlite3_errcode(db);
+
+            sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":package_id"), package_id);
+        }
+
+        return queryDependencies(stmt, dependencies);
+    });
+}
 
+/**
+ * Walk a package's dependencies depth-first with an explicit stack, adding packages in the same order as recursion would:
+ * A package, then the subtree of each of its dependencies in turn, in setup.ini order.
+ * Dependencies are expanded by their current version. Both resolver modes list packages this way,
+ * only getting dependencies differently: expand() fills (ID, name) of a package's dependencies, returning SQLITE_DONE
+ * on success. Its package_id is 0 for pkg_name itself.
+ */
+int CygpmDatabase::walkDependencies(vector<string> &dependency_list, const char *pkg_name,
+                                    function<int(sqlite3_int64 package_id, vector<pair<sqlite3_int64, string>> &dependencies)> expand)
+{
     /**
-     * Add the current package into dependency_list
+     * Packages already in dependency_list are neither added nor expanded again.
+     * This prevents infinite dependency. Example: `terminfo` and `terminfo-extra` depends on each other.
+     * Also, make sure that we have only one item in list. This can save time when downloading.
      */
+    if (isInVector_string(dependency_list, pkg_name))
+        return 1;
+
+    unordered_set<string> listed;         // Packages listed before this call. Usually none
+    if (!dependency_list.empty())
+        listed.insert(dependency_list.begin(), dependency_list.end());
+    unordered_set<sqlite3_int64> visited; // Packages reached in this call, by PACKAGE_NAMES.ID
+
+    dependency_list.push_back(string(pkg_name));
+
+    struct Frame
+    {
+        vector<pair<sqlite3_int64, string>> dependencies; // (ID, name) of a package's dependencies
+        size_t next;                                      // Next one to visit
+    };
+    vector<Frame> stack(1, Frame{{}, 0});
+    sqlite3_int64 package_id = 0;
+
+    while (true)
+    {
+        rc = expand(package_id, stack.back().dependencies);
+        if (rc != SQLITE_DONE)
+        {
+            SQLITE_ERR_RETURN; // Also exit the walk on error
+        }
+
+        // Find the next package to visit: the first new dependency of the deepest package
+        const pair<sqlite3_int64, string> *dependency = NULL;
+        while (!stack.empty() && dependency == NULL)
+        {
+            Frame &top = stack.back();
+            if (top.next == top.dependencies.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+
+            const pair<sqlite3_int64, string> &candidate = top.dependencies[top.next++];
+            if (visited.insert(candidate.first).second && candidate.second != pkg_name &&
+                (listed.empty() || listed.count(candidate.second) == 0))
+                dependency = &candidate;
+        }
+
+        if (dependency == NULL)
+            break;
+
+        dependency_list.push_back(dependency->second);
+        package_id = dependency->first;
+
+        stack.push_back({{}, 0}); // Moves frames below, but not their dependencies' storage
+    }
+
+    return 0;
+}
 
-    // (1) If package is not in current dependency list, add it to list
-    if (!isInVector_string(dependency_list, pkg_name))
-        dependency_list.push_back(string(pkg_name));
-    // (2) Or, if existed, no need to add it, just return.
-    //     This can prevent infinite dependency. Example: `terminfo` and `terminfo-extra` depends on each other.
-    //     Also, make sure that we have only one item in list. This can save time when downloading.
+/**
+ * Step a bound dependency statement, collecting (ID, name) of dependencies in setup.ini order.
+ * Returns SQLITE_DONE on success.
+ */
+int CygpmDatabase::queryDependencies(sqlite3_stmt *stmt, vector<pair<sqlite3_int64, string>> &dependencies)
+{
+    StatementCursor cursor(stmt);
+    while (cursor.next())
+        dependencies.emplace_back(cursor.getInt64(1), cursor.getString(0));
+
+    rc = cursor.getResult();
+    if (rc != SQLITE_DONE)
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+
+    return rc;
+}
+
+/**
+ * Resolve all dependencies in one query: SQLite finds the closure, then returns the dependencies of every package
+ * in it. UNION drops packages already reached, so cycles end by themselves. Packages already in dependency_list
+ * are not expanded, as in the walk.
+ *
+ * SQLite reaches packages breadth-first, in no guaranteed order. So the list is ordered by walking the returned
+ * dependencies in memory, the same way as the walk does.
+ */
+int CygpmDatabase::findDependencies_CTE(vector<string> &dependency_list, const char *pkg_name, const char *version)
+{
+    if (isInVector_string(dependency_list, pkg_name))
+        return 1;
+
+    string listed_json = "[";
+    for (const string &listed : dependency_list)
+    {
+        if (listed_json.length() > 1)
+            listed_json += ',';
+        appendJsonString(listed_json, listed);
+    }
+    listed_json += ']';
+
+    sqlite3_stmt *stmt = getStatement(STMT_RESOLVE_DEPENDENCIES);
+    if (stmt == NULL)
+    {
+        SQLITE_ERR_RETURN;
+    }
+
+    SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
+    SQLITE_BIND_MY_COLUMN(":listed", listed_json.c_str());
+    if (version != NULL)
+    {
+        string_view version_trimmed = rtrimView(version); // Versions are stored trimmed
+        SQLITE_BIND_MY_COLUMN_VIEW(":version", version_trimmed);
+    }
     else
+        sqlite3_bind_null(stmt, sqlite3_bind_parameter_index(stmt, ":version"));
+
+    // Dependencies of each package in the closure, by its ID (0 for pkg_name itself), in setup.ini order
+    unordered_map<sqlite3_int64, vector<pair<sqlite3_int64, string>>> dependencies;
+    StatementCursor cursor(stmt);
+    while (cursor.next())
+        dependencies[cursor.getInt64(0)].emplace_back(cursor.getInt64(1), cursor.getString(2));
+
+    if (!cursor.isDone())
+    {
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+
+        SQLITE_ERR_RETURN;
+    }
+
+    return walkDependencies(dependency_list, pkg_name, [&](sqlite3_int64 package_id, vector<pair<sqlite3_int64, string>> &package_dependencies) {
+        auto found = dependencies.find(package_id);
+        if (found != dependencies.end())
+            package_dependencies = move(found->second);
+        return SQLITE_DONE;
+    });
+}
+
+int CygpmDatabase::findDependents(vector<string> &dependent_list, const char *pkg_name)
+{
+    if (resolverMode == RESOLVER_MODE_CTE)
+        return findDependents_CTE(dependent_list, pkg_name);
+
+    // Packages already listed are skipped, as findDependencies() does
+    if (isInVector_string(dependent_list, pkg_name))
         return 1;
+    unordered_set<string> listed(dependent_list.begin(), dependent_list.end());
+    dependent_list.push_back(string(pkg_name));
 
     /**
-     * Start query
+     * Reverse edges of the graph are the precomputed index of dependents: Each step is an array slice
      */
+    const DependencyGraph &graph = getDependencyGraph();
+    uint32_t node = graph.findNode(pkg_name);
+    if (node == DependencyGraph::NO_NODE)
+        return 0;
 
-    /* Variables */
-    char **dbResult;   // Results from sqlite3_get_table()
-    int nRow, nColumn; // Row/Column count
-    int i, j;          // Loop variable
+    vector<uint32_t> dependents;
+    graph.reverseClosure(node, dependents);
 
-    /**
-     * NOTICE: In sqlite3_get_table(), dbResult's column values are successive. 
-     * It stores the dimension table (traditional RxC) into a flat array.
-     * So, dbResult[0, nColumn - 1] are column names, dbResult[nColumn, len(dbResult)] are column values.
-     */
-    int nIndex; // Current index of dbResult
+    for (size_t i = 1; i < dependents.size(); i++) // First one is the package itself
+    {
+        string_view dependent = graph.getName(dependents[i]);
+        if (listed.insert(string(dependent)).second)
+            dependent_list.push_back(string(dependent));
+    }
 
-    /* Execute SQL statement */
-    rc = sqlite3_get_table(db, query, &dbResult, &nRow, &nColumn, &zErrMsg);
-    if (rc != SQLITE_OK)
+    return 0;
+}
+
+int CygpmDatabase::findDependents_CTE(vector<string> &dependent_list, const char *pkg_name)
+{
+    if (isInVector_string(dependent_list, pkg_name))
+        return 1;
+    unordered_set<string> listed(dependent_list.begin(), dependent_list.end());
+    listed.insert(pkg_name);
+    dependent_list.push_back(string(pkg_name));
+
+    sqlite3_stmt *stmt = getStatement(STMT_RESOLVE_DEPENDENTS);
+    if (stmt == NULL)
     {
-        cerr << "SQL error: " << zErrMsg << endl;
+        SQLITE_ERR_RETURN;
+    }
+
+    SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
 
-        SQLITE_ERR_RETURN; // Also exit recursion on error
+    // First row is the package itself, already added
+    StatementCursor cursor(stmt);
+    while (cursor.next())
+    {
+        const char *dependent = cursor.getCString(0);
+        if (listed.insert(dependent).second)
+            dependent_list.push_back(string(dependent));
     }
 
-    /* Process query results */
-    nIndex = nColumn; // Initialize nIndex
-    for (i = 0; i < nRow; i++)
+    if (!cursor.isDone())
     {
-        // For any dependencies, just do the same:
-        //      -> Fetch their dependencies recursively.
-        findDependencies(dependency_list, dbResult[nIndex], getNewestVersion(dbResult[nIndex])); // dbResult[nIndex] is the current dependency item
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
 
-        nIndex++; // Go to the next row
+        SQLITE_ERR_RETURN;
     }
 
     return 0;
 }
 
-char *CygpmDatabase::getNewestVersion(const char *pkg_name)
+int CygpmDatabase::findOrphans(const vector<InstalledPackage> &installed, vector<string> &orphans)
 {
-    /* Variables */
-    char **dbResult;   // Results from sqlite3_get_table()
-    int nRow, nColumn; // Row/Column count
+    orphans.clear();
 
-    int nIndex; // Current index of dbResult
-
-    /* SQL query */
-    const char *SQL_GET_NEWEST_VERSION = "SELECT VERSION FROM PKG_INFO WHERE PKG_NAME = '%s';";
-
-    char *query = new char[100 + strlen(SQL_GET_NEWEST_VERSION) + strlen(pkg_name)]; // Actual SQL query rendered by sprintf()
-    sprintf(query, SQL_GET_NEWEST_VERSION, pkg_name);
+    if (resolverMode == RESOLVER_MODE_CTE)
+        return findOrphans_CTE(installed, orphans);
 
     /**
-     * Execute SQL statement to get newest version
+     * Mark what manually installed packages need, directly or not, in one walk of the graph.
+     * Everything else installed is an orphan, including dependencies needed only by other orphans.
+     * Packages not in setup.ini have no node, so they're neither reported nor walked.
      */
-    rc = sqlite3_get_table(db, query, &dbResult, &nRow, &nColumn, &zErrMsg);
-    if (rc != SQLITE_OK)
+    const uint8_t IS_INSTALLED = 1, IS_NEEDED = 2;
+
+    const DependencyGraph &graph = getDependencyGraph();
+    vector<uint8_t> marks(graph.getNumNodes(), 0);
+    vector<uint32_t> needed; // Walk queue
+
+    for (const InstalledPackage &pkg : installed)
     {
-        cerr << "SQL error: " << zErrMsg << endl;
+        uint32_t node = graph.findNode(pkg.name);
+        if (node == DependencyGraph::NO_NODE)
+            continue;
+
+        marks[node] |= IS_INSTALLED;
+        if (pkg.user_picked && !(marks[node] & IS_NEEDED))
+        {
+            marks[node] |= IS_NEEDED;
+            needed.push_back(node);
+        }
+    }
 
-        return NULL;
+    for (size_t next = 0; next < needed.size(); next++)
+    {
+        for (uint32_t dependency : graph.getDependencies(needed[next]))
+        {
+            if (!(marks[dependency] & IS_NEEDED))
+            {
+                marks[dependency] |= IS_NEEDED;
+                needed.push_back(dependency);
+            }
+        }
     }
 
-    /**
-     * dbResult[index] is what we want.
-     */
-    nIndex = nColumn;               // Initialize nIndex
-    return rtrim(dbResult[nIndex]); // Trim trailing space, as findDependencies() doesn't trim spaces
+    // Nodes are numbered in name order, so this lists orphans in name order
+    for (uint32_t node = 0; node < graph.getNumNodes(); node++)
+        if (marks[node] == IS_INSTALLED)
+            orphans.push_back(string(graph.getName(node)));
+
+    return 0;
 }
 
-char *CygpmDatabase::getShortDesc(const char *pkg_name)
+int CygpmDatabase::findOrphans_CTE(const vector<InstalledPackage> &installed, vector<string> &orphans)
 {
-    /* SQL query */
-    const char *SQL = R"(
-        SELECT SDESC FROM PKG_INFO WHERE PKG_NAME = '%s';
-    )";
+    /**
+     * Pass installed packages as one JSON array of [name, user_picked], joined against the catalog in a single query
+     */
+    string json = "[";
+    for (size_t i = 0; i < installed.size(); i++)
+    {
+        json += i == 0 ? "[" : ",[";
+        appendJsonString(json, installed[i].name);
+        json += installed[i].user_picked ? ",1]" : ",0]";
+    }
+    json += "]";
 
-    char *query = new char[100 + strlen(SQL) + strlen(pkg_name)]; // Actual SQL query rendered by sprintf()
-    sprintf(query, SQL, pkg_name);
+    sqlite3_stmt *stmt = getStatement(STMT_FIND_ORPHANS);
+    if (stmt == NULL)
+    {
+        SQLITE_ERR_RETURN;
+    }
 
-    return queryOneResult(query);
-}
+    SQLITE_BIND_MY_COLUMN(":installed", json.c_str());
 
-char *CygpmDatabase::getLongDesc(const char *pkg_name)
-{
-    /* SQL query */
-    const char *SQL = R"(
-        SELECT LDESC FROM PKG_INFO WHERE PKG_NAME = '%s';
-    )";
+    StatementCursor cursor(stmt);
+    while (cursor.next())
+        orphans.push_back(cursor.getString(0));
+
+    if (!cursor.isDone())
+    {
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
 
-    char *query = new char[100 + strlen(SQL) + strlen(pkg_name)]; // Actual SQL query rendered by sprintf()
-    sprintf(query, SQL, pkg_name);
+        SQLITE_ERR_RETURN;
+    }
 
-    return queryOneResult(query);
+    return 0;
 }
 
-char *CygpmDatabase::getCategory(const char *pkg_name)
+char *CygpmDatabase::getNewestVersion(const char *pkg_name)
 {
-    /* SQL query */
-    const char *SQL = R"(
-        SELECT CATEGORY FROM PKG_INFO WHERE PKG_NAME = '%s';
-    )";
+    char *result = NULL;
+
+    sqlite3_stmt *stmt = getStatement(STMT_GET_NEWEST_VERSION);
+    if (stmt == NULL)
+        return NULL;
 
-    char *query = new char[100 + strlen(SQL) + strlen(pkg_name)]; // Actual SQL query rendered by sprintf()
-    sprintf(query, SQL, pkg_name);
+    SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
 
-    return queryOneResult(query);
+    // Keys sort as versions do, so the newest is the last in IDX_VERSIONS_KEY
+    StatementCursor cursor(stmt);
+    if (cursor.next())
+        result = strdup(cursor.getCString(0));
+    else if (!cursor.isDone())
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+
+    return result;
 }
 
-char *CygpmDatabase::getInstallPakPath(const char *pkg_name, const char *version = NULL)
+char *CygpmDatabase::getShortDesc(const char *pkg_name)
 {
-    /** Build SQL statement */
-    const char *SQL = R"(
-        SELECT INSTALL_PAK_PATH FROM %s WHERE PKG_NAME = '%s' AND VERSION LIKE '%s';
-    )";
+    return queryPackageColumn(pkg_name, NULL, PKG_COL_SDESC);
+}
 
-    string s_version(version == NULL ? getNewestVersion(pkg_name) : version);
-    s_version += "%"; // Use wildcard to match possible trailing spaces
+char *CygpmDatabase::getLongDesc(const char *pkg_name)
+{
+    return queryPackageColumn(pkg_name, NULL, PKG_COL_LDESC);
+}
 
-    char *query = new char[120 + strlen(SQL) + strlen(pkg_name) + (version == NULL ? 0 : strlen(version))];
-    sprintf(query, SQL,
-            version == NULL ? "PKG_INFO" : "PREV_VERSIONS",
-            pkg_name,
-            s_version.c_str());
+char *CygpmDatabase::getCategory(const char *pkg_name)
+{
+    return queryPackageColumn(pkg_name, NULL, PKG_COL_CATEGORY);
+}
 
-    return queryOneResult(query);
+char *CygpmDatabase::getInstallPakPath(const char *pkg_name, const char *version = NULL)
+{
+    return queryPackageColumn(pkg_name, version, PKG_COL_INSTALL_PAK_PATH);
 }
 
 char *CygpmDatabase::getInstallPakSize(const char *pkg_name, const char *version = NULL)
 {
-    /** Build SQL statement */
-    const char *SQL = R"(
-        SELECT INSTALL_PAK_SIZE FROM %s WHERE PKG_NAME = '%s' AND VERSION LIKE '%s';
-    )";
-
-    string s_version(version == NULL ? getNewestVersion(pkg_name) : version);
-    s_version += "%"; // Use wildcard to match possible trailing spaces
-
-    char *query = new char[120 + strlen(SQL) + strlen(pkg_name) + (version == NULL ? 0 : strlen(version))];
-    sprintf(query, SQL,
-            version == NULL ? "PKG_INFO" : "PREV_VERSIONS",
-            pkg_name,
-            s_version.c_str());
-
-    return queryOneResult(query);
+    return queryPackageColumn(pkg_name, version, PKG_COL_INSTALL_PAK_SIZE);
 }
 
 char *CygpmDatabase::getInstallPakSHA512(const char *pkg_name, const char *version = NULL)
 {
-    /** Build SQL statement */
-    const char *SQL = R"(
-        SELECT INSTALL_PAK_SHA512 FROM %s WHERE PKG_NAME = '%s' AND VERSION LIKE '%s';
-    )";
+    return queryPackageColumn(pkg_name, version, PKG_COL_INSTALL_PAK_SHA512);
+}
 
-    string s_version(version == NULL ? getNewestVersion(pkg_name) : version);
-    s_version += "%"; // Use wildcard to match possible trailing spaces
+char *CygpmDatabase::getSourcePakPath(const char *pkg_name, const char *version = NULL)
+{
+    return queryPackageColumn(pkg_name, version, PKG_COL_SOURCE_PAK_PATH);
+}
 
-    char *query = new char[120 + strlen(SQL) + strlen(pkg_name) + (version == NULL ? 0 : strlen(version))];
-    sprintf(query, SQL,
-            version == NULL ? "PKG_INFO" : "PREV_VERSIONS",
-            pkg_name,
-            s_version.c_str());
+char *CygpmDatabase::getSourcePakSize(const char *pkg_name, const char *version = NULL)
+{
+    return queryPackageColumn(pkg_name, version, PKG_COL_SOURCE_PAK_SIZE);
+}
 
-    return queryOneResult(query);
+char *CygpmDatabase::getSourcePakSHA512(const char *pkg_name, const char *version = NULL)
+{
+    return queryPackageColumn(pkg_name, version, PKG_COL_SOURCE_PAK_SHA512);
 }
 
-char *CygpmDatabase::getSourcePakPath(const char *pkg_name, const char *version = NULL)
+vector<string> CygpmDatabase::getPrevVersions(const char *pkg_name)
 {
-    /** Build SQL statement */
-    const char *SQL = R"(
-        SELECT SOURCE_PAK_PATH FROM %s WHERE PKG_NAME = '%s' AND VERSION LIKE '%s';
-    )";
+    vector<string> result; // Prev version list to be returned
+
+    sqlite3_stmt *stmt = getStatement(STMT_GET_PREV_VERSIONS);
+    if (stmt == NULL)
+        return result;
 
-    string s_version(version == NULL ? getNewestVersion(pkg_name) : version);
-    s_version += "%"; // Use wildcard to match possible trailing spaces
+    SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
 
-    char *query = new char[120 + strlen(SQL) + strlen(pkg_name) + (version == NULL ? 0 : strlen(version))];
-    sprintf(query, SQL,
-            version == NULL ? "PKG_INFO" : "PREV_VERSIONS",
-            pkg_name,
-            s_version.c_str());
+    /**
+     * Add version numbers to list
+     */
+    StatementCursor cursor(stmt);
+    while (cursor.next())
+        result.push_back(cursor.getString(0));
 
-    return queryOneResult(query);
+    return result;
 }
 
-char *CygpmDatabase::getSourcePakSize(const char *pkg_name, const char *version = NULL)
+vector<string> CygpmDatabase::getVersionsInRange(const char *pkg_name, const char *min_version, const char *max_version)
 {
-    /** Build SQL statement */
-    const char *SQL = R"(
-        SELECT SOURCE_PAK_SIZE FROM %s WHERE PKG_NAME = '%s' AND VERSION LIKE '%s';
-    )";
+    vector<string> result;
 
-    string s_version(version == NULL ? getNewestVersion(pkg_name) : version);
-    s_version += "%"; // Use wildcard to match possible trailing spaces
+    sqlite3_stmt *stmt = getStatement(STMT_GET_VERSIONS_IN_RANGE);
+    if (stmt == NULL)
+        return result;
+
+    /**
+     * Compare keys, not versions, so the range is a slice of IDX_VERSIONS_KEY.
+     * An open end is a key below (empty) or above all others. A key starts with its epoch's digit count,
+     * at most 255 (see makeVersionKey()). A count of 255 is followed by digits, so 0xFF 0xFF is above any key.
+     */
+    string min_key, max_key;
+    if (min_version != NULL)
+        makeVersionKey(min_version, min_key);
+    if (max_version != NULL)
+        makeVersionKey(max_version, max_key);
+    else
+        max_key = "\xFF\xFF";
 
-    char *query = new char[120 + strlen(SQL) + strlen(pkg_name) + (version == NULL ? 0 : strlen(version))];
-    sprintf(query, SQL,
-            version == NULL ? "PKG_INFO" : "PREV_VERSIONS",
-            pkg_name,
-            s_version.c_str());
+    SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
+    sqlite3_bind_blob(stmt, sqlite3_bind_parameter_index(stmt, ":min_key"), min_key.data(), min_key.length(), SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, sqlite3_bind_parameter_index(stmt, ":max_key"), max_key.data(), max_key.length(), SQLITE_STATIC);
 
-    return queryOneResult(query);
+    StatementCursor cursor(stmt);
+    while (cursor.next())
+        result.push_back(cursor.getString(0));
+
+    if (!cursor.isDone())
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+
+    return result;
 }
 
-char *CygpmDatabase::getSourcePakSHA512(const char *pkg_name, const char *version = NULL)
+/**
+ * Read a text column of STMT_GET_PACKAGE_RECORDS, trimmed like the getters do
+ */
+static string columnString(const StatementCursor &cursor, int column)
 {
-    /** Build SQL statement */
-    const char *SQL = R"(
-        SELECT SOURCE_PAK_SHA512 FROM %s WHERE PKG_NAME = '%s' AND VERSION LIKE '%s';
-    )";
+    return string(rtrimView(cursor.getText(column)));
+}
 
-    string s_version(version == NULL ? getNewestVersion(pkg_name) : version);
-    s_version += "%"; // Use wildcard to match possible trailing spaces
+/**
+ * Read a package file's path, size & digest from STMT_GET_PACKAGE_RECORDS
+ */
+static void columnPak(const StatementCursor &cursor, int column, PackageRecord::Pak &pak)
+{
+    pak.path = columnString(cursor, column);
 
-    char *query = new char[120 + strlen(SQL) + strlen(pkg_name) + (version == NULL ? 0 : strlen(version))];
-    sprintf(query, SQL,
-            version == NULL ? "PKG_INFO" : "PREV_VERSIONS",
-            pkg_name,
-            s_version.c_str());
+    if (cursor.getType(column + 1) == SQLITE_INTEGER)
+        pak.size = cursor.getInt64(column + 1);
 
-    return queryOneResult(query);
+    if (cursor.getType(column + 2) == SQLITE_BLOB) // Digests are stored as bytes, unless they're not hex in setup.ini
+    {
+        string_view digest = cursor.getBlob(column + 2);
+        pak.sha512 = encodeHex((const unsigned char *)digest.data(), digest.length());
+    }
+    else
+        pak.sha512 = columnString(cursor, column + 2);
 }
 
-vector<const char *> CygpmDatabase::getPrevVersions(const char *pkg_name)
+/**
+ * Fetch many packages in one query, instead of one query per column per package.
+ * version == NULL means current versions. Otherwise look it up in previous versions of every package.
+ */
+int CygpmDatabase::getPackageRecords(const vector<string> &pkg_names, const char *version, vector<PackageRecord> &records)
 {
-    /* Variables */
-    vector<const char *> result; // Prev version list to be returned
-    char **dbResult;             // Results from sqlite3_get_table()
-    int nRow, nColumn;           // Row/Column count
-
-    int nIndex; // Current index of dbResult
+    records.assign(pkg_names.size(), PackageRecord());
+    if (pkg_names.empty())
+        return SQLITE_OK;
 
     /**
-     * Build SQL statement
+     * Pass names as one JSON array, so the batch is a single statement execution
      */
-    const char *SQL_GET_PREV_VERSIONS = R"(
-        SELECT VERSION FROM PREV_VERSIONS WHERE PKG_NAME = '%s';
-    )";
-    char *query = new char[100 + strlen(SQL_GET_PREV_VERSIONS) + strlen(pkg_name)];
-    sprintf(query, SQL_GET_PREV_VERSIONS, pkg_name);
+    string json = "[";
+    for (size_t i = 0; i < pkg_names.size(); i++)
+    {
+        records[i].pkg_name = pkg_names[i];
 
-    /**
-     * Execute SQL statement to get previous versions
-     */
-    rc = sqlite3_get_table(db, query, &dbResult, &nRow, &nColumn, &zErrMsg);
-    if (rc != SQLITE_OK)
+        if (i > 0)
+            json += ',';
+        appendJsonString(json, pkg_names[i]);
+    }
+    json += "]";
+
+    sqlite3_stmt *stmt = getStatement(STMT_GET_PACKAGE_RECORDS);
+    if (stmt == NULL)
     {
-        cerr << "SQL error: " << zErrMsg << endl;
+        SQLITE_ERR_RETURN;
+    }
 
-        return result;
+    SQLITE_BIND_MY_COLUMN(":pkg_names", json.c_str());
+    if (version != NULL)
+    {
+        string_view version_trimmed = rtrimView(version); // Versions are stored trimmed
+        SQLITE_BIND_MY_COLUMN_VIEW(":version", version_trimmed);
     }
+    else
+        sqlite3_bind_null(stmt, sqlite3_bind_parameter_index(stmt, ":version"));
 
-    /**
-     * Parse dbResult.
-     */
-    nIndex = nColumn; // Initialize nIndex
-    for (int i = 0; i < nRow; i++)
+    StatementCursor cursor(stmt);
+    while (cursor.next())
     {
-        result.push_back(rtrim(dbResult[nIndex])); // Add version number to list, trimming trailing spaces
+        PackageRecord &record = records[cursor.getInt64(0)];
+        if (record.found)
+            continue; // A version listed twice in setup.ini. Keep the first (lowest ID), as getters do
+
+        record.found = true;
+        record.version = columnString(cursor, 1);
+        record.sdesc = columnString(cursor, 2);
+        record.ldesc = columnString(cursor, 3);
+        record.category = columnString(cursor, 4);
+        columnPak(cursor, 5, record.install);
+        columnPak(cursor, 8, record.source);
+    }
 
-        nIndex++;
+    if (!cursor.isDone())
+    {
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+
+        SQLITE_ERR_RETURN;
     }
 
-    return result;
+    return SQLITE_OK;
 }
 
-inline char *CygpmDatabase::queryOneResult(const char *sql_statement)
+/**
+ * Query one column of a package.
+ * version == NULL means the current (newest) version. Otherwise look it up in previous versions.
+ */
+char *CygpmDatabase::queryPackageColumn(const char *pkg_name, const char *version, PackageColumn column)
 {
-    /* Variables */
-    char **dbResult;   // Results from sqlite3_get_table()
-    int nRow, nColumn; // Row/Column count
+    char *result = NULL;
 
-    int nIndex; // Current index of dbResult
+    sqlite3_stmt *stmt = getStatement(version == NULL ? STMT_GET_PACKAGE : STMT_GET_PREV_VERSION);
+    if (stmt == NULL)
+        return NULL;
 
-    /**
-     * Execute SQL statement to get required data
-     * In this method, you can only query one column and one row.
-     */
-    rc = sqlite3_get_table(db, sql_statement, &dbResult, &nRow, &nColumn, &zErrMsg);
-    if (rc != SQLITE_OK)
+    SQLITE_BIND_MY_COLUMN(":pkg_name", pkg_name);
+    if (version != NULL)
     {
-        cerr << "SQL error: " << zErrMsg << endl;
+        string_view version_trimmed = rtrimView(version); // Versions are stored trimmed
+        SQLITE_BIND_MY_COLUMN_VIEW(":version", version_trimmed);
+    }
 
-        return NULL;
+    StatementCursor cursor(stmt);
+    if (cursor.next())
+    {
+        const char *text = cursor.getCString(column);
+        if (text != NULL)
+            result = rtrim(strdup(text)); // Column text is gone once the cursor resets the statement, so copy it
     }
+    else if (!cursor.isDone())
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
 
-    /**
-     * dbResult[index] is what we want.
-     */
-    nIndex = nColumn;               // Initialize nIndex
-    return rtrim(dbResult[nIndex]); // Trim trailing space, as findDependencies() doesn't trim spaces
-}
\ No newline at end of file
+    return result;
+}
@@ -0,0 +1,434 @@
+#include "database.h"
+
+/**
+ * Catalog tables (schema version 4, see CATALOG_SCHEMA_VERSION).
+ *
+ * Every package name (including dependencies not in setup.ini) gets an integer ID in PACKAGE_NAMES.
+ * PACKAGES holds per-package fields, VERSIONS holds both current & previous versions,
+ * and DEPENDENCIES links a version to the names it depends on. Joins compare integers only.
+ * Sizes are INTEGERs, SHA512 digests are 64-byte BLOBs (or the original text if it's not hex).
+ * Each version has its sortable key (see makeVersionKey()) as a BLOB, so version order is plain BLOB order,
+ * which any SQLite (even one without our collation) can index & compare.
+ */
+static const char *SQL_CREATE_PACKAGE_NAMES = R"(
+    CREATE TABLE IF NOT EXISTS "PACKAGE_NAMES" (
+        "ID"	INTEGER PRIMARY KEY,
+        "NAME"	TEXT NOT NULL UNIQUE
+    );
+)";
+
+static const char *SQL_CREATE_PACKAGES = R"(
+    CREATE TABLE IF NOT EXISTS "PACKAGES" (
+        "ID"	INTEGER PRIMARY KEY,
+        "SDESC"	TEXT,
+        "LDESC"	TEXT,
+        "CATEGORY"	TEXT,
+        "OBSOLETES__RAW"	TEXT,
+        "PROVIDES__RAW"	TEXT,
+        "CONFLICTS__RAW"	TEXT,
+        "BLOCK_HASH"	INTEGER,
+        FOREIGN KEY("ID") REFERENCES "PACKAGE_NAMES"("ID")
+    );
+)";
+
+static const char *SQL_CREATE_VERSIONS = R"(
+    CREATE TABLE IF NOT EXISTS "VERSIONS" (
+        "ID"	INTEGER PRIMARY KEY,
+        "PACKAGE_ID"	INTEGER NOT NULL,
+        "VERSION"	TEXT NOT NULL,
+        "VERSION_KEY"	BLOB,
+        "IS_CURRENT"	INTEGER NOT NULL,
+        "REQUIRES__RAW"	TEXT,
+        "DEPENDS2__RAW"	TEXT,
+        "INSTALL_PAK_PATH"	TEXT,
+        "INSTALL_PAK_SIZE"	INTEGER,
+        "INSTALL_PAK_SHA512"	BLOB,
+        "SOURCE_PAK_PATH"	TEXT,
+        "SOURCE_PAK_SIZE"	INTEGER,
+        "SOURCE_PAK_SHA512"	BLOB,
+        FOREIGN KEY("PACKAGE_ID") REFERENCES "PACKAGES"("ID")
+    );
+)";
+
+static const char *SQL_CREATE_DEPENDENCIES = R"(
+    CREATE TABLE IF NOT EXISTS "DEPENDENCIES" (
+        "VERSION_ID"	INTEGER NOT NULL,
+        "DEPENDS_ON"	INTEGER NOT NULL,
+        FOREIGN KEY("VERSION_ID") REFERENCES "VERSIONS"("ID"),
+        FOREIGN KEY("DEPENDS_ON") REFERENCES "PACKAGE_NAMES"("ID")
+    );
+)";
+
+static const char *SQL_CREATE_METADATA = R"(
+    CREATE TABLE IF NOT EXISTS "METADATA" (
+        "KEY"	TEXT NOT NULL,
+        "VALUE"	TEXT,
+        PRIMARY KEY("KEY")
+    );
+)";
+
+/**
+ * Full-text search over package names & descriptions.
+ *
+ * Both FTS5 tables index PACKAGE_SEARCH_SOURCE without storing the text again (external content).
+ * - PACKAGE_SEARCH: Words, for ranked keyword search with prefix matching & snippets.
+ * - PACKAGE_TRIGRAMS: Trigrams, so that substring & regex searches only check rows containing a literal.
+ *
+ * A full build indexes all packages in one pass once they're loaded, which is several times faster
+ * than indexing them row by row. Only then triggers on PACKAGES are added, keeping later
+ * (incremental) builds in sync. See updateSearchIndex().
+ */
+static const char *SQL_CREATE_SEARCH = R"(
+    CREATE VIEW IF NOT EXISTS "PACKAGE_SEARCH_SOURCE" AS
+        SELECT P.ID, N.NAME, P.SDESC, P.LDESC FROM "PACKAGES" P JOIN "PACKAGE_NAMES" N ON N.ID = P.ID;
+
+    CREATE VIRTUAL TABLE IF NOT EXISTS "PACKAGE_SEARCH" USING fts5(
+        NAME, SDESC, LDESC, content='PACKAGE_SEARCH_SOURCE', content_rowid='ID'
+    );
+    CREATE VIRTUAL TABLE IF NOT EXISTS "PACKAGE_TRIGRAMS" USING fts5(
+        NAME, SDESC, LDESC, content='PACKAGE_SEARCH_SOURCE', content_rowid='ID', tokenize='trigram', detail='none'
+    );
+)";
+
+static const char *SQL_CREATE_SEARCH_TRIGGERS = R"(
+    CREATE TRIGGER IF NOT EXISTS "PACKAGES_SEARCH_INSERT" AFTER INSERT ON "PACKAGES" BEGIN
+        INSERT INTO "PACKAGE_SEARCH" (rowid, NAME, SDESC, LDESC)
+            SELECT NEW.ID, NAME, NEW.SDESC, NEW.LDESC FROM "PACKAGE_NAMES" WHERE ID = NEW.ID;
+        INSERT INTO "PACKAGE_TRIGRAMS" (rowid, NAME, SDESC, LDESC)
+            SELECT NEW.ID, NAME, NEW.SDESC, NEW.LDESC FROM "PACKAGE_NAMES" WHERE ID = NEW.ID;
+    END;
+
+    CREATE TRIGGER IF NOT EXISTS "PACKAGES_SEARCH_DELETE" AFTER DELETE ON "PACKAGES" BEGIN
+        INSERT INTO "PACKAGE_SEARCH" (PACKAGE_SEARCH, rowid, NAME, SDESC, LDESC)
+            SELECT 'delete', OLD.ID, NAME, OLD.SDESC, OLD.LDESC FROM "PACKAGE_NAMES" WHERE ID = OLD.ID;
+        INSERT INTO "PACKAGE_TRIGRAMS" (PACKAGE_TRIGRAMS, rowid, NAME, SDESC, LDESC)
+            SELECT 'delete', OLD.ID, NAME, OLD.SDESC, OLD.LDESC FROM "PACKAGE_NAMES" WHERE ID = OLD.ID;
+    END;
+)";
+
+static const char *SQL_REBUILD_SEARCH = R"(
+    INSERT INTO "PACKAGE_SEARCH" (PACKAGE_SEARCH) VALUES ('rebuild');
+    INSERT INTO "PACKAGE_TRIGRAMS" (PACKAGE_TRIGRAMS) VALUES ('rebuild');
+)";
+
+/**
+ * Secondary indexes. Created by createIndexes() after data is loaded,
+ * so that they're built in one pass instead of being updated on every insert.
+ */
+static const char *SQL_CREATE_INDEXES = R"(
+    CREATE INDEX IF NOT EXISTS "IDX_VERSIONS_PACKAGE" ON "VERSIONS" (PACKAGE_ID, VERSION, IS_CURRENT);
+    CREATE INDEX IF NOT EXISTS "IDX_VERSIONS_KEY" ON "VERSIONS" (PACKAGE_ID, VERSION_KEY);
+    CREATE INDEX IF NOT EXISTS "IDX_DEPENDENCIES_VERSION" ON "DEPENDENCIES" (VERSION_ID, DEPENDS_ON);
+    CREATE INDEX IF NOT EXISTS "IDX_DEPENDENCIES_DEPENDS_ON" ON "DEPENDENCIES" (DEPENDS_ON, VERSION_ID); -- Reverse lookups: who depends on a package
+)";
+
+static const string SQL_SET_SCHEMA_VERSION = "PRAGMA user_version = " + to_string(CATALOG_SCHEMA_VERSION) + ";";
+
+/**
+ * Convert schema version 0 (text tables) into the current one.
+ * Dependency rows are translated as they are, so the dependency map needn't be rebuilt.
+ * Version 0 has no obsoletes/provides/conflicts nor block hashes. They're left NULL, so the next
+ * incremental build finds every block changed, and stores them.
+ */
+static const char *SQL_MIGRATE_FROM_V0 = R"(
+    INSERT INTO "PACKAGE_NAMES" (NAME) SELECT PKG_NAME FROM "PKG_INFO" ORDER BY rowid;
+    INSERT OR IGNORE INTO "PACKAGE_NAMES" (NAME) SELECT DEPENDS_ON FROM "DEPENDENCY_MAP" ORDER BY ID;
+
+    INSERT INTO "PACKAGES" (ID, SDESC, LDESC, CATEGORY, OBSOLETES__RAW, PROVIDES__RAW, CONFLICTS__RAW, BLOCK_HASH)
+        SELECT N.ID, P.SDESC, P.LDESC, P.CATEGORY, NULL, NULL, NULL, NULL
+        FROM "PKG_INFO" P JOIN "PACKAGE_NAMES" N ON N.NAME = P.PKG_NAME;
+
+    INSERT INTO "VERSIONS" (PACKAGE_ID, VERSION, VERSION_KEY, IS_CURRENT, REQUIRES__RAW, DEPENDS2__RAW,
+                            INSTALL_PAK_PATH, INSTALL_PAK_SIZE, INSTALL_PAK_SHA512,
+                            SOURCE_PAK_PATH, SOURCE_PAK_SIZE, SOURCE_PAK_SHA512)
+        SELECT N.ID, rtrim(P.VERSION), cygpm_version_key(P.VERSION), 1, P.REQUIRES__RAW, P.DEPENDS2__RAW,
+               P.INSTALL_PAK_PATH, NULLIF(P.INSTALL_PAK_SIZE, ''), cygpm_digest(P.INSTALL_PAK_SHA512),
+               P.SOURCE_PAK_PATH, NULLIF(P.SOURCE_PAK_SIZE, ''), cygpm_digest(P.SOURCE_PAK_SHA512)
+        FROM "PKG_INFO" P JOIN "PACKAGE_NAMES" N ON N.NAME = P.PKG_NAME ORDER BY P.rowid;
+
+    INSERT INTO "VERSIONS" (PACKAGE_ID, VERSION, VERSION_KEY, IS_CURRENT, REQUIRES__RAW, DEPENDS2__RAW,
+                            INSTALL_PAK_PATH, INSTALL_PAK_SIZE, INSTALL_PAK_SHA512,
+                            SOURCE_PAK_PATH, SOURCE_PAK_SIZE, SOURCE_PAK_SHA512)
+        SELECT N.ID, rtrim(V.VERSION), cygpm_version_key(V.VERSION), 0, NULL, V.DEPENDS2__RAW,
+               V.INSTALL_PAK_PATH, NULLIF(V.INSTALL_PAK_SIZE, ''), cygpm_digest(V.INSTALL_PAK_SHA512),
+               V.SOURCE_PAK_PATH, NULLIF(V.SOURCE_PAK_SIZE, ''), cygpm_digest(V.SOURCE_PAK_SHA512)
+        FROM "PREV_VERSIONS" V JOIN "PACKAGE_NAMES" N ON N.NAME = V.PKG_NAME ORDER BY V.rowid;
+
+    INSERT INTO "DEPENDENCIES" (VERSION_ID, DEPENDS_ON)
+        SELECT V.ID, D.ID
+        FROM "DEPENDENCY_MAP" M
+            JOIN "PACKAGE_NAMES" N ON N.NAME = M.PKG_NAME
+            JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID AND V.VERSION = rtrim(M.VERSION)
+            JOIN "PACKAGE_NAMES" D ON D.NAME = M.DEPENDS_ON
+        ORDER BY M.ID;
+
+    DROP TABLE "PKG_INFO";
+    DROP TABLE "PREV_VERSIONS";
+    DROP TABLE "DEPENDENCY_MAP";
+)";
+
+/**
+ * Versions 2 & 3 have no version keys
+ */
+static const char *SQL_MIGRATE_VERSION_KEYS = R"(
+    ALTER TABLE "VERSIONS" ADD COLUMN "VERSION_KEY" BLOB;
+    UPDATE "VERSIONS" SET VERSION_KEY = cygpm_version_key(VERSION);
+)";
+
+/**
+ * SQL function cygpm_digest(text): A hex digest as BLOB, the text itself if it's not hex, NULL if it's empty.
+ * Same conversion as insertVersion() does on binding.
+ */
+static void sqlDigest(sqlite3_context *context, int /*argc*/, sqlite3_value **argv)
+{
+    const char *text = (const char *)sqlite3_value_text(argv[0]);
+    int length = sqlite3_value_bytes(argv[0]);
+    unsigned char digest[64];
+
+    if (text == NULL || length == 0)
+        sqlite3_result_null(context);
+    else if (size_t digestSize = decodeHex(text, length, digest, sizeof(digest)))
+        sqlite3_result_blob(context, digest, digestSize, SQLITE_TRANSIENT);
+    else
+        sqlite3_result_text(context, text, length, SQLITE_TRANSIENT);
+}
+
+/**
+ * Collation CYGWIN_VERSION, ordering text as versions: ... ORDER BY VERSION COLLATE CYGWIN_VERSION
+ */
+static int collateVersions(void *, int length_a, const void *a, int length_b, const void *b)
+{
+    return compareVersions(string_view((const char *)a, length_a), string_view((const char *)b, length_b));
+}
+
+/**
+ * SQL function cygpm_version_key(text): Sortable key of a version as BLOB, see makeVersionKey(). NULL if text is NULL
+ */
+static void sqlVersionKey(sqlite3_context *context, int /*argc*/, sqlite3_value **argv)
+{
+    const char *text = (const char *)sqlite3_value_text(argv[0]);
+    if (text == NULL)
+    {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    string key;
+    makeVersionKey(string_view(text, sqlite3_value_bytes(argv[0])), key);
+    sqlite3_result_blob(context, key.data(), key.length(), SQLITE_TRANSIENT);
+}
+
+void CygpmDatabase::registerVersionFunctions()
+{
+    sqlite3_create_collation_v2(db, "CYGWIN_VERSION", SQLITE_UTF8, NULL, collateVersions, NULL);
+    sqlite3_create_function(db, "cygpm_version_key", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, sqlVersionKey, NULL, NULL);
+}
+
+int CygpmDatabase::createTable()
+{
+    /**
+     * Initialize transaction, unless a full rebuild has begun one already
+     */
+    if (!fullRebuild)
+        initTransaction();
+    if (errorLevel != 0)
+    {
+        cerr << "Error while creating tables: Transaction starting failed" << endl;
+        return errorLevel;
+    }
+
+    /**
+     * Drop old tables, unless we're going to build incrementally on top of them.
+     * Tables of older schema versions can't be updated incrementally.
+     *
+     * A full rebuild is one transaction: It's left open here, and parseAndBuildDatabase() loads packages &
+     * creates indexes in it before committing. So readers see the old catalog until the new one is complete,
+     * and a failed build leaves the old one as it was.
+     */
+    if (!incrementalBuild || !hasCurrentSchema())
+    {
+        fullRebuild = true;
+
+        const char *SQL_DROP_TABLES = R"(
+            DROP TABLE IF EXISTS "PACKAGE_TRIGRAMS";
+            DROP TABLE IF EXISTS "PACKAGE_SEARCH";
+            DROP VIEW IF EXISTS "PACKAGE_SEARCH_SOURCE";
+            DROP TABLE IF EXISTS "PKG_INFO";
+            DROP TABLE IF EXISTS "DEPENDENCY_MAP";
+            DROP TABLE IF EXISTS "PREV_VERSIONS";
+            DROP TABLE IF EXISTS "DEPENDENCIES";
+            DROP TABLE IF EXISTS "VERSIONS";
+            DROP TABLE IF EXISTS "PACKAGES";
+            DROP TABLE IF EXISTS "PACKAGE_NAMES";
+            DROP TABLE IF EXISTS "METADATA";
+        )";
+        execTransactionSQL(SQL_DROP_TABLES);
+    }
+
+    /**
+     * Create catalog tables
+     */
+    execTransactionSQL(SQL_CREATE_PACKAGE_NAMES);
+    execTransactionSQL(SQL_CREATE_PACKAGES);
+    execTransactionSQL(SQL_CREATE_VERSIONS);
+    execTransactionSQL(SQL_CREATE_DEPENDENCIES);
+    execTransactionSQL(SQL_CREATE_SEARCH); // Filled by parseAndBuildDatabase()
+
+    /**
+     * Create metadata table, storing setup.ini's header
+     */
+    execTransactionSQL(SQL_CREATE_METADATA);
+
+    execTransactionSQL(SQL_SET_SCHEMA_VERSION.c_str());
+
+    if (fullRebuild)
+    {
+        cerr << "Tables created, to be committed with the catalog" << endl;
+        return errorLevel;
+    }
+
+    /**
+     * Commit transaction & Get result
+     */
+    errorLevel = commitTransaction();
+    if (errorLevel == 0)
+        cerr << "Tables created" << endl;
+    else
+        cerr << "Error while creating tables: " << zErrMsg << endl;
+
+    return errorLevel;
+}
+
+int CygpmDatabase::createIndexes()
+{
+    auto time_start = chrono::steady_clock::now();
+
+    rc = sqlite3_exec(db, SQL_CREATE_INDEXES, NULL, 0, &zErrMsg);
+    if (rc != SQLITE_OK)
+    {
+        cerr << "Error while creating indexes: " << zErrMsg << endl;
+
+        SQLITE_ERR_RETURN;
+    }
+
+    auto time_elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - time_start);
+    cerr << "> Indexes created in " << time_elapsed.count() << " ms" << endl;
+
+    checkQueryPlans();
+
+    return SQLITE_OK;
+}
+
+int CygpmDatabase::updateSearchIndex()
+{
+    // Triggers are there once the index is filled. Then it's up to date already
+    if (StatementCursor(db, R"(SELECT 1 FROM sqlite_master WHERE type = 'trigger' AND name = 'PACKAGES_SEARCH_INSERT';)").next())
+        return SQLITE_OK;
+
+    auto time_start = chrono::steady_clock::now();
+
+    rc = sqlite3_exec(db, SQL_REBUILD_SEARCH, NULL, 0, &zErrMsg);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, SQL_CREATE_SEARCH_TRIGGERS, NULL, 0, &zErrMsg);
+
+    if (rc != SQLITE_OK)
+    {
+        cerr << "Error while building search index: " << zErrMsg << endl;
+        return rc;
+    }
+
+    auto time_elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - time_start);
+    cerr << "> Search index built in " << time_elapsed.count() << " ms" << endl;
+
+    return SQLITE_OK;
+}
+
+int CygpmDatabase::getSchemaVersion()
+{
+    StatementCursor cursor(db, "PRAGMA user_version;");
+
+    return cursor.next() ? cursor.getInt(0) : -1;
+}
+
+bool CygpmDatabase::hasCurrentSchema()
+{
+    return getSchemaVersion() == CATALOG_SCHEMA_VERSION;
+}
+
+int CygpmDatabase::migrateSchema()
+{
+    int version = getSchemaVersion();
+
+    if (version == 0)
+    {
+        // A new database is version 0 too, but has nothing to migrate. (The cursor is a temporary, gone before tables are changed)
+        if (!StatementCursor(db, R"(SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'PKG_INFO';)").next())
+            return SQLITE_OK;
+    }
+    else if (version != 2 && version != 3) // Current, or unknown
+        return SQLITE_OK;
+
+    cerr << "Migrating database to schema version " << CATALOG_SCHEMA_VERSION << endl;
+    auto time_start = chrono::steady_clock::now();
+
+    sqlite3_create_function(db, "cygpm_digest", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, sqlDigest, NULL, NULL);
+
+    initTransaction();
+    if (errorLevel != 0)
+    {
+        cerr << "Error while migrating database: Transaction starting failed" << endl;
+        return errorLevel;
+    }
+
+    if (version == 0)
+    {
+        execTransactionSQL(SQL_CREATE_PACKAGE_NAMES);
+        execTransactionSQL(SQL_CREATE_PACKAGES);
+        execTransactionSQL(SQL_CREATE_VERSIONS);
+        execTransactionSQL(SQL_CREATE_DEPENDENCIES);
+        execTransactionSQL(SQL_CREATE_INDEXES); // Old tables had their indexes. Also speeds up translating dependencies
+
+        /**
+         * Should it fail anyway (e.g. tables changed by hand), the migration is rolled back below,
+         * and the database is rebuilt on the next update.
+         */
+        rc = sqlite3_exec(db, SQL_MIGRATE_FROM_V0, NULL, 0, &zErrMsg);
+    }
+    else
+        rc = sqlite3_exec(db, SQL_MIGRATE_VERSION_KEYS, NULL, 0, &zErrMsg);
+
+    // Versions before 3 have no search tables
+    if (rc == SQLITE_OK && version < 3)
+        rc = sqlite3_exec(db, SQL_CREATE_SEARCH, NULL, 0, &zErrMsg);
+    if (rc == SQLITE_OK && version < 3)
+        rc = updateSearchIndex();
+
+    // Indexes added since, including the one of version keys
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, SQL_CREATE_INDEXES, NULL, 0, &zErrMsg);
+    if (rc != SQLITE_OK)
+    {
+        cerr << "> Cannot migrate: " << zErrMsg << ". Database will be rebuilt on the next update" << endl;
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+
+        SQLITE_ERR_RETURN;
+    }
+
+    execTransactionSQL(SQL_SET_SCHEMA_VERSION.c_str());
+
+    errorLevel = commitTransaction();
+    if (errorLevel != 0)
+    {
+        cerr << "Error while migrating database: " << zErrMsg << endl;
+        return errorLevel;
+    }
+
+    // Dropped tables leave free pages behind. Give them back, or the file never shrinks
+    if (version == 0)
+        sqlite3_exec(db, "VACUUM;", NULL, 0, NULL);
+
+    auto time_elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - time_start);
+    cerr << "> Migrated in " << time_elapsed.count() << " ms" << endl;
+
+    return SQLITE_OK;
+}
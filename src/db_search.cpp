@@ -0,0 +1,223 @@
+#include "database.h"
+
+/**
+ * Quote text as an FTS5 string, so that it's matched as it is
+ */
+static string quoteFTS(const string &text)
+{
+    string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static bool containsIgnoreCase(const char *text, const string &lowerNeedle)
+{
+    if (text == NULL)
+        return false;
+
+    string lowerText(text);
+    transform(lowerText.begin(), lowerText.end(), lowerText.begin(), ::tolower);
+    return lowerText.find(lowerNeedle) != string::npos;
+}
+
+/**
+ * Find the longest run of literal characters every match of an ECMAScript regex must contain.
+ * Only runs out of groups are taken, and none if there's an alternation, so the result is always safe
+ * to pre-filter with. An empty result means no pre-filter.
+ */
+static string findRequiredLiteral(const char *pattern)
+{
+    string best, run;
+    int depth = 0; // Group nesting
+
+    auto endRun = [&]() {
+        if (depth == 0 && run.length() > best.length())
+            best = run;
+        run.clear();
+    };
+
+    for (const char *p = pattern; *p != '\0'; p++)
+    {
+        switch (*p)
+        {
+        case '|':
+            return string(); // Any branch may match
+        case '?':
+        case '*':
+        case '{':
+            if (!run.empty())
+                run.pop_back(); // Previous character is optional (or repeated a given number of times)
+            endRun();
+            if (*p == '{') // Skip the repeat count
+                while (p[1] != '\0' && *p != '}')
+                    p++;
+            break;
+        case '(':
+            endRun();
+            depth++;
+            break;
+        case ')':
+            endRun();
+            depth--;
+            break;
+        case '[': // Character class. Skip to its end
+            endRun();
+            for (p++; *p != '\0' && *p != ']'; p++)
+                if (*p == '\\' && p[1] != '\0')
+                    p++;
+            if (*p == '\0')
+                return best;
+            break;
+        case '\\':
+            if (p[1] == '\0')
+                return best;
+            if (isalnum((unsigned char)p[1])) // \d, \w, \b etc.
+            {
+                endRun();
+
+                // Skip operands too, so they aren't taken as literals: \xHH, \uHHHH, \cX, and digits of \1 etc.
+                int numOperands = p[1] == 'x' ? 2 : (p[1] == 'u' ? 4 : (p[1] == 'c' ? 1 : 0));
+                p++;
+                for (; numOperands > 0 && p[1] != '\0'; numOperands--)
+                    p++;
+                if (isdigit((unsigned char)*p))
+                    while (isdigit((unsigned char)p[1]))
+                        p++;
+                break;
+            }
+            run += p[1]; // Escaped punctuation is a literal
+            p++;
+            break;
+        case '+': // Previous character is still required once
+        case '.':
+        case '^':
+        case '$':
+            endRun();
+            break;
+        default:
+            run += *p;
+        }
+    }
+    endRun();
+
+    return best;
+}
+
+/**
+ * Ranked keyword search. Every keyword must appear in name or descriptions, as a word or a word's prefix.
+ */
+int CygpmDatabase::searchPackages(const char *keywords, int limit, vector<SearchResult> &results)
+{
+    results.clear();
+
+    // Quote each keyword, so that FTS5 syntax in it is taken literally, then make it a prefix query
+    string query;
+    istringstream words(keywords);
+    for (string word; words >> word;)
+        query += (query.empty() ? "" : " ") + quoteFTS(word) + "*";
+
+    if (query.empty())
+        return SQLITE_OK;
+
+    sqlite3_stmt *stmt = getStatement(STMT_SEARCH_PACKAGES);
+    if (stmt == NULL)
+    {
+        SQLITE_ERR_RETURN;
+    }
+
+    SQLITE_BIND_MY_COLUMN(":query", query.c_str());
+    sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":limit"), limit);
+
+    StatementCursor cursor(stmt);
+    while (cursor.next())
+        results.push_back({cursor.getString(0), cursor.getString(1), cursor.getString(2), cursor.getDouble(3)});
+
+    if (!cursor.isDone())
+    {
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+
+        SQLITE_ERR_RETURN;
+    }
+
+    return SQLITE_OK;
+}
+
+int CygpmDatabase::searchPackagesBySubstring(const char *text, vector<string> &pkg_names)
+{
+    pkg_names.clear();
+
+    string lowerText(text);
+    transform(lowerText.begin(), lowerText.end(), lowerText.begin(), ::tolower);
+
+    return scanSearchCandidates(text, [&](const char **columns) {
+        if (containsIgnoreCase(columns[0], lowerText) || containsIgnoreCase(columns[1], lowerText) || containsIgnoreCase(columns[2], lowerText))
+            pkg_names.push_back(columns[0]);
+    });
+}
+
+int CygpmDatabase::searchPackagesByRegex(const char *pattern, vector<string> &pkg_names)
+{
+    pkg_names.clear();
+
+    regex expression;
+    try
+    {
+        expression.assign(pattern, regex::ECMAScript | regex::icase | regex::nosubs | regex::optimize);
+    }
+    catch (const regex_error &e)
+    {
+        cerr << "Invalid regex " << pattern << ": " << e.what() << endl;
+        return SQLITE_MISUSE;
+    }
+
+    return scanSearchCandidates(findRequiredLiteral(pattern), [&](const char **columns) {
+        for (int i = 0; i < 3; i++)
+        {
+            if (columns[i] != NULL && regex_search(columns[i], expression))
+            {
+                pkg_names.push_back(columns[0]);
+                break;
+            }
+        }
+    });
+}
+
+/**
+ * Visit packages whose name or descriptions may contain literal, in name order.
+ * It's a LIKE over the trigram index: If literal has 3 or more characters, only rows having its trigrams are read,
+ * otherwise every row is. '%' & '_' in literal are left as wildcards, which only let more rows through.
+ */
+int CygpmDatabase::scanSearchCandidates(const string &literal, function<void(const char **columns)> visit)
+{
+    sqlite3_stmt *stmt = getStatement(STMT_SEARCH_TRIGRAMS);
+    if (stmt == NULL)
+    {
+        SQLITE_ERR_RETURN;
+    }
+
+    string pattern = "%" + literal + "%";
+    SQLITE_BIND_MY_COLUMN(":pattern", pattern.c_str());
+
+    const char *columns[3];
+    StatementCursor cursor(stmt);
+    while (cursor.next())
+    {
+        for (int i = 0; i < 3; i++)
+            columns[i] = cursor.getCString(i);
+        visit(columns);
+    }
+
+    if (!cursor.isDone())
+    {
+        cerr << "SQL error: " << sqlite3_errmsg(db) << endl;
+
+        SQLITE_ERR_RETURN;
+    }
+
+    return SQLITE_OK;
+}
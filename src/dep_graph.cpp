@@ -0,0 +1,332 @@
+#include "dep_graph.h"
+
+static const char GRAPH_MAGIC[8] = {'C', 'P', 'M', 'D', 'G', 'R', '1', '\0'};
+
+/**
+ * Offsets of n items into an array of size items: they never decrease, and the last one is the end
+ */
+static bool isValidOffsetArray(const uint32_t *offsets, uint32_t n, uint32_t size)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (offsets[i] > offsets[i + 1])
+            return false;
+    }
+
+    return offsets[n] == size;
+}
+
+static bool isValidEdgeArray(const uint32_t *edges, uint32_t e, uint32_t numNodes)
+{
+    for (uint32_t i = 0; i < e; i++)
+    {
+        if (edges[i] >= numNodes)
+            return false;
+    }
+
+    return true;
+}
+
+DependencyGraph::DependencyGraph()
+{
+}
+
+DependencyGraph::~DependencyGraph()
+{
+    clear();
+}
+
+void DependencyGraph::assign(const vector<string> &sortedNames, const vector<pair<uint32_t, uint32_t>> &edges, uint64_t newStamp)
+{
+    clear();
+
+    uint32_t n = sortedNames.size();
+    uint32_t e = edges.size();
+
+    arrays.assign(((size_t)n + 1) * 3 + (size_t)e * 2, 0);
+    uint32_t *name_offsets = arrays.data();
+    uint32_t *forward_offsets = name_offsets + n + 1;
+    uint32_t *forward_edges = forward_offsets + n + 1;
+    uint32_t *reverse_offsets = forward_edges + e;
+    uint32_t *reverse_edges = reverse_offsets + n + 1;
+
+    /**
+     * Name pool
+     */
+    for (uint32_t i = 0; i < n; i++)
+    {
+        name_offsets[i] = namePool.length();
+        namePool += sortedNames[i];
+    }
+    name_offsets[n] = namePool.length();
+
+    /**
+     * Edge arrays, by counting sort. It's stable, so each node keeps its edges in the given order.
+     */
+    for (auto &edge : edges)
+    {
+        forward_offsets[edge.first + 1]++;
+        reverse_offsets[edge.second + 1]++;
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+        forward_offsets[i + 1] += forward_offsets[i];
+        reverse_offsets[i + 1] += reverse_offsets[i];
+    }
+
+    vector<uint32_t> forward_fill(forward_offsets, forward_offsets + n), reverse_fill(reverse_offsets, reverse_offsets + n);
+    for (auto &edge : edges)
+    {
+        forward_edges[forward_fill[edge.first]++] = edge.second;
+        reverse_edges[reverse_fill[edge.second]++] = edge.first;
+    }
+
+    numNodes = n;
+    numEdges = e;
+    stamp = newStamp;
+    setArrays(arrays.data(), namePool.data());
+}
+
+int DependencyGraph::save(const char *graph_fileName)
+{
+    FileHeader header = {};
+    memcpy(header.magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC));
+    header.stamp = stamp;
+    header.num_nodes = numNodes;
+    header.num_edges = numEdges;
+    header.name_pool_size = nameOffsets != NULL ? nameOffsets[numNodes] : 0;
+
+    size_t num_array_items = ((size_t)numNodes + 1) * 3 + (size_t)numEdges * 2;
+
+    /**
+     * Write to a temporary file first, so a reader never sees a partial graph
+     */
+    string tmp_fileName = string(graph_fileName) + ".tmp";
+    FILE *out = fopen(tmp_fileName.c_str(), "wb");
+    if (out == NULL)
+    {
+        cerr << "Error while saving dependency graph: Cannot write " << tmp_fileName << endl;
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              (nameOffsets == NULL || fwrite(nameOffsets, sizeof(uint32_t), num_array_items, out) == num_array_items) &&
+              (header.name_pool_size == 0 || fwrite(names, 1, header.name_pool_size, out) == header.name_pool_size);
+    ok = fclose(out) == 0 && ok;
+
+    if (!ok || rename(tmp_fileName.c_str(), graph_fileName) != 0)
+    {
+        cerr << "Error while saving dependency graph: Cannot write " << graph_fileName << endl;
+        remove(tmp_fileName.c_str());
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    return CPM_OK;
+}
+
+int DependencyGraph::open(const char *graph_fileName, uint64_t expectedStamp)
+{
+    clear();
+
+    int rc = mapFileForScan(graph_fileName, graphFile);
+    if (rc != CPM_OK)
+        return rc;
+
+    /**
+     * Validate graph
+     */
+    const FileHeader *header = (const FileHeader *)graphFile.data;
+    if (graphFile.size < sizeof(FileHeader) || memcmp(header->magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC)) != 0 ||
+        graphFile.size != sizeof(FileHeader) + (((size_t)header->num_nodes + 1) * 3 + (size_t)header->num_edges * 2) * sizeof(uint32_t) + header->name_pool_size)
+    {
+        cerr << "Broken dependency graph: " << graph_fileName << endl;
+        clear();
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    if (header->stamp != expectedStamp)
+    {
+        clear();
+        return CPM_INDEX_OUTDATED;
+    }
+
+    numNodes = header->num_nodes;
+    numEdges = header->num_edges;
+    stamp = header->stamp;
+
+    const uint32_t *base = (const uint32_t *)(graphFile.data + sizeof(FileHeader));
+    setArrays(base, (const char *)(base + ((size_t)numNodes + 1) * 3 + (size_t)numEdges * 2));
+
+    /**
+     * Every offset & edge must stay within its array, as lookups & walks don't check them
+     */
+    if (!isValidOffsetArray(nameOffsets, numNodes, header->name_pool_size) ||
+        !isValidOffsetArray(forwardOffsets, numNodes, numEdges) || !isValidOffsetArray(reverseOffsets, numNodes, numEdges) ||
+        !isValidEdgeArray(forwardEdges, numEdges, numNodes) || !isValidEdgeArray(reverseEdges, numEdges, numNodes))
+    {
+        cerr << "Broken dependency graph: " << graph_fileName << endl;
+        clear();
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    return CPM_OK;
+}
+
+void DependencyGraph::clear()
+{
+    if (graphFile.data != NULL)
+        unmapFile(graphFile);
+
+    arrays.clear();
+    arrays.shrink_to_fit();
+    namePool.clear();
+    namePool.shrink_to_fit();
+
+    nameOffsets = forwardOffsets = forwardEdges = reverseOffsets = reverseEdges = NULL;
+    names = NULL;
+    numNodes = numEdges = 0;
+    stamp = 0;
+}
+
+void DependencyGraph::setArrays(const uint32_t *base, const char *namePoolBase)
+{
+    nameOffsets = base;
+    forwardOffsets = nameOffsets + numNodes + 1;
+    forwardEdges = forwardOffsets + numNodes + 1;
+    reverseOffsets = forwardEdges + numEdges;
+    reverseEdges = reverseOffsets + numNodes + 1;
+    names = namePoolBase;
+}
+
+bool DependencyGraph::isEmpty() const
+{
+    return nameOffsets == NULL;
+}
+
+uint32_t DependencyGraph::getNumNodes() const
+{
+    return numNodes;
+}
+
+uint32_t DependencyGraph::getNumEdges() const
+{
+    return numEdges;
+}
+
+uint64_t DependencyGraph::getStamp() const
+{
+    return stamp;
+}
+
+uint32_t DependencyGraph::findNode(string_view pkg_name) const
+{
+    uint32_t low = 0, high = numNodes;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if (getName(mid) < pkg_name)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low < numNodes && getName(low) == pkg_name ? low : NO_NODE;
+}
+
+string_view DependencyGraph::getName(uint32_t node) const
+{
+    return string_view(names + nameOffsets[node], nameOffsets[node + 1] - nameOffsets[node]);
+}
+
+DependencyGraph::EdgeRange DependencyGraph::getDependencies(uint32_t node) const
+{
+    return {forwardEdges + forwardOffsets[node], forwardEdges + forwardOffsets[node + 1]};
+}
+
+DependencyGraph::EdgeRange DependencyGraph::getDependents(uint32_t node) const
+{
+    return {reverseEdges + reverseOffsets[node], reverseEdges + reverseOffsets[node + 1]};
+}
+
+void DependencyGraph::walk(uint32_t node, const uint32_t *offsets, const uint32_t *edges, vector<uint32_t> &result) const
+{
+    result.clear();
+    if (node >= numNodes)
+        return;
+
+    /**
+     * Breadth-first. result doubles as the queue: Nodes before `next` are expanded.
+     */
+    vector<bool> visited(numNodes, false);
+    visited[node] = true;
+    result.push_back(node);
+
+    for (size_t next = 0; next < result.size(); next++)
+    {
+        uint32_t current = result[next];
+        for (uint32_t i = offsets[current]; i < offsets[current + 1]; i++)
+        {
+            if (!visited[edges[i]])
+            {
+                visited[edges[i]] = true;
+                result.push_back(edges[i]);
+            }
+        }
+    }
+}
+
+void DependencyGraph::closure(uint32_t node, vector<uint32_t> &result) const
+{
+    walk(node, forwardOffsets, forwardEdges, result);
+}
+
+void DependencyGraph::reverseClosure(uint32_t node, vector<uint32_t> &result) const
+{
+    walk(node, reverseOffsets, reverseEdges, result);
+}
+
+bool DependencyGraph::sortTopologically(vector<uint32_t> &nodes) const
+{
+    /**
+     * Kahn's algorithm, on the subgraph of given nodes.
+     * A node is ready once all its dependencies (within the subgraph) are placed.
+     */
+    const uint32_t NOT_IN_SUBGRAPH = UINT32_MAX;
+    vector<uint32_t> numPending(numNodes, NOT_IN_SUBGRAPH); // Node -> its dependencies not placed yet
+
+    for (uint32_t node : nodes)
+        numPending[node] = 0;
+
+    for (uint32_t node : nodes)
+        for (uint32_t dependency : getDependencies(node))
+            if (dependency != node && numPending[dependency] != NOT_IN_SUBGRAPH)
+                numPending[node]++;
+
+    vector<uint32_t> order;
+    order.reserve(nodes.size());
+
+    for (uint32_t node : nodes) // Keep the given order among ready nodes
+        if (numPending[node] == 0)
+            order.push_back(node);
+
+    for (size_t next = 0; next < order.size(); next++)
+    {
+        for (uint32_t dependent : getDependents(order[next]))
+        {
+            if (dependent != order[next] && numPending[dependent] != NOT_IN_SUBGRAPH && --numPending[dependent] == 0)
+                order.push_back(dependent);
+        }
+    }
+
+    bool hasCycle = order.size() < nodes.size();
+    if (hasCycle)
+    {
+        for (uint32_t node : nodes)
+            if (numPending[node] != 0)
+                order.push_back(node);
+    }
+
+    nodes.swap(order);
+    return !hasCycle;
+}
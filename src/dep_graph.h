@@ -0,0 +1,102 @@
+/**
+ * dep_graph.h  //  In-memory dependency graph, in compressed sparse row (CSR) form.
+ *
+ * Nodes are package names (including dependencies not in setup.ini), numbered in name order.
+ * Edges come from current versions. A node's forward edges (what it depends on) and reverse
+ * edges (what depends on it) are contiguous slices of two edge arrays, located by offset arrays.
+ * Closures and topological orders are then plain array walks, without SQLite in the loop.
+ *
+ * A graph is built from the database (see CygpmDatabase::buildDependencyMap()), and can be
+ * saved to a sidecar file, which is mapped back as it is. Like SetupIniIndex, the file is
+ * a local cache in native byte order.
+ */
+
+#ifndef DEP_GRAPH_H
+#define DEP_GRAPH_H
+
+#include "stdafx.hpp"
+#include "utils.h"
+
+using namespace std;
+
+class DependencyGraph
+{
+public:
+    static const uint32_t NO_NODE = UINT32_MAX;
+
+    /**
+     * Edges of a node, for range-based for
+     */
+    struct EdgeRange
+    {
+        const uint32_t *first;
+        const uint32_t *last;
+
+        const uint32_t *begin() const { return first; }
+        const uint32_t *end() const { return last; }
+        size_t size() const { return last - first; }
+    };
+
+private:
+    struct FileHeader
+    {
+        char magic[8];          // GRAPH_MAGIC
+        uint64_t stamp;         // Identifies the catalog the graph is built from, see open()
+        uint32_t num_nodes;
+        uint32_t num_edges;
+        uint32_t name_pool_size;
+        uint32_t reserved;      // Always 0
+    };
+
+    /**
+     * Arrays, laid out in this order both in memory and in the sidecar file:
+     * name offsets [n + 1], forward offsets [n + 1], forward edges [e], reverse offsets [n + 1], reverse edges [e].
+     * Name pool follows.
+     */
+    vector<uint32_t> arrays; // Storage of a graph built in memory
+    string namePool;
+    MappedFile graphFile;    // Storage of a graph loaded from file
+
+    const uint32_t *nameOffsets = NULL;
+    const uint32_t *forwardOffsets = NULL;
+    const uint32_t *forwardEdges = NULL;
+    const uint32_t *reverseOffsets = NULL;
+    const uint32_t *reverseEdges = NULL;
+    const char *names = NULL;
+    uint32_t numNodes = 0;
+    uint32_t numEdges = 0;
+    uint64_t stamp = 0;
+
+public:
+    DependencyGraph();
+    ~DependencyGraph();
+    DependencyGraph(const DependencyGraph &) = delete;
+    DependencyGraph &operator=(const DependencyGraph &) = delete;
+
+    void assign(const vector<string> &sortedNames, const vector<pair<uint32_t, uint32_t>> &edges, uint64_t newStamp); // Build from names (sorted, unique)
+                                                                                                                    // & (dependent, dependency) node pairs
+    int save(const char *graph_fileName);                     // Write graph into a sidecar file
+    int open(const char *graph_fileName, uint64_t expectedStamp); // Map a sidecar file. CPM_INDEX_OUTDATED if it's built from another catalog
+    void clear();
+
+    bool isEmpty() const;
+    uint32_t getNumNodes() const;
+    uint32_t getNumEdges() const;
+    uint64_t getStamp() const;
+
+    uint32_t findNode(string_view pkg_name) const; // Binary search. NO_NODE if not found
+    string_view getName(uint32_t node) const;
+    EdgeRange getDependencies(uint32_t node) const; // Forward edges, in the order they're listed in setup.ini
+    EdgeRange getDependents(uint32_t node) const;   // Reverse edges
+
+    void closure(uint32_t node, vector<uint32_t> &result) const;        // Node & everything it depends on, breadth-first
+    void reverseClosure(uint32_t node, vector<uint32_t> &result) const; // Node & everything depending on it, breadth-first
+    bool sortTopologically(vector<uint32_t> &nodes) const;             // Reorder (unique) nodes so that dependencies come first.
+                                                                        // false if they have cycles, whose nodes are put last
+
+private:
+    void setArrays(const uint32_t *base, const char *namePoolBase); // Point array pointers into storage
+    void walk(uint32_t node, const uint32_t *offsets, const uint32_t *edges, vector<uint32_t> &result) const;
+};
+
+#endif
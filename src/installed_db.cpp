@@ -0,0 +1,99 @@
+#include "installed_db.h"
+
+static const string_view INSTALLED_DB_MAGIC = "INSTALLED.DB ";
+
+/**
+ * Split a line into words separated by spaces
+ */
+static vector<string_view> splitWords(string_view line)
+{
+    vector<string_view> words;
+    size_t start = 0;
+
+    while (start < line.length())
+    {
+        size_t end = line.find(' ', start);
+        if (end == string_view::npos)
+            end = line.length();
+        if (end > start)
+            words.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+
+    return words;
+}
+
+/**
+ * "bash-4.4.12-3.tar.xz" of "bash" -> "4.4.12-3"
+ */
+static string_view versionOfPackageFile(string_view pkg_name, string_view pak_fileName)
+{
+    if (pak_fileName.length() <= pkg_name.length() + 1 || pak_fileName.substr(0, pkg_name.length()) != pkg_name ||
+        pak_fileName[pkg_name.length()] != '-')
+        return string_view();
+
+    string_view version = pak_fileName.substr(pkg_name.length() + 1);
+    size_t extension = version.rfind(".tar");
+    if (extension == string_view::npos || extension == 0)
+        return string_view();
+
+    return version.substr(0, extension);
+}
+
+int readInstalledDb(const char *installeddb_fileName, vector<InstalledPackage> &packages)
+{
+    packages.clear();
+
+    MappedFile file;
+    int rc = mapFileForScan(installeddb_fileName, file);
+    if (rc != CPM_OK)
+        return rc;
+
+    string_view text(file.data, file.size);
+    int db_version = 0;
+
+    for (size_t start = 0; start < text.length();)
+    {
+        size_t end = text.find('\n', start);
+        if (end == string_view::npos)
+            end = text.length();
+
+        string_view line = rtrimView(text.substr(start, end - start)); // Also drops '\r'
+        start = end + 1;
+
+        /**
+         * First line: "INSTALLED.DB <version>"
+         */
+        if (db_version == 0)
+        {
+            if (line.substr(0, INSTALLED_DB_MAGIC.length()) != INSTALLED_DB_MAGIC ||
+                (db_version = atoi(string(line.substr(INSTALLED_DB_MAGIC.length())).c_str())) <= 0)
+                break;
+            continue;
+        }
+
+        /**
+         * Then "<name> <package file> <flags>"
+         */
+        vector<string_view> words = splitWords(line);
+        if (words.size() < 2)
+            continue;
+
+        InstalledPackage pkg;
+        pkg.name = string(words[0]);
+        pkg.version = string(versionOfPackageFile(words[0], words[1]));
+        pkg.user_picked = db_version < 3 || words.size() < 3 || (atoi(string(words[2]).c_str()) & 1) != 0;
+
+        packages.push_back(move(pkg));
+    }
+
+    unmapFile(file);
+
+    if (db_version == 0)
+    {
+        cerr << "Not an installed.db: " << installeddb_fileName << endl;
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    return CPM_OK;
+}
@@ -0,0 +1,30 @@
+/**
+ * installed_db.h  //  Read Cygwin Setup's record of installed packages.
+ *
+ * Setup keeps it in /etc/setup/installed.db, a text file of one line per package:
+ *
+ *     INSTALLED.DB 3
+ *     bash bash-4.4.12-3.tar.xz 1
+ *
+ * i.e. name, package file, and (since version 3) whether the user picked it, rather than
+ * it being pulled in as a dependency. Lines are in name order.
+ */
+
+#ifndef INSTALLED_DB_H
+#define INSTALLED_DB_H
+
+#include "stdafx.hpp"
+#include "utils.h"
+
+using namespace std;
+
+struct InstalledPackage
+{
+    string name;
+    string version;   // Taken from package file name. Empty if it's not named "<name>-<version>.tar.*"
+    bool user_picked; // Installed manually. Always true in databases older than version 3, which don't tell
+};
+
+int readInstalledDb(const char *installeddb_fileName, vector<InstalledPackage> &packages); // Read all lines. CPM_FILE_ACCESS_ERROR if it's not an installed.db
+
+#endif
@@ -1,8 +1,11 @@
 /**
  * lex.export.h  //  Export symbols to be used by C++.
- * 
+ *
  * If you link C-compiled object/library to C++, you must export their symbols separately
  * by using `extern "C"`. For variables, use "extern" in addition.
+ *
+ * The lexer is reentrant: every state (yytext, yyleng, current buffer, etc.) lives in a
+ * scanner object (yyscan_t), so each thread can run its own scanner at the same time.
  */
 
 #ifndef LEX_EXPORT_H
@@ -10,13 +13,22 @@
 #ifdef __cplusplus
 extern "C"
 {
-    int yylex(void);                  // The core function of lexer. Parse at a time from current position.
-    extern char *yytext;              // Current matched text
-    extern int yyleng;                // yytext's length
-    extern int yylineno;              // Current line number
-    void yyrestart(FILE *input_file); // Redirect the lexer's input stream
-    int yywrap(void);                 // Inform if the lexer should parse more than one file.
-                                      // Return 1 if only parse one.
+    typedef void *yyscan_t;                         // Scanner object handle
+    typedef struct yy_buffer_state *YY_BUFFER_STATE; // Lexer input buffer handle
+
+    int yylex_init(yyscan_t *scanner);                                        // Create a scanner
+    int yylex_init_extra(struct SetupIniInput *input, yyscan_t *scanner);    // Create a scanner reading from a custom input source
+    int yylex_destroy(yyscan_t scanner);                                      // Destroy a scanner, also releasing its buffers
+
+    int yylex(yyscan_t scanner);                         // The core function of lexer. Parse at a time from current position.
+    char *yyget_text(yyscan_t scanner);                  // Current matched text (yytext)
+    int yyget_leng(yyscan_t scanner);                    // yytext's length (yyleng)
+    int yyget_lineno(yyscan_t scanner);                  // Current line number (yylineno)
+    void yyrestart(FILE *input_file, yyscan_t scanner); // Redirect the lexer's input stream
+
+    YY_BUFFER_STATE yy_scan_buffer(char *base, size_t size, yyscan_t scanner); // Scan an in-memory buffer in place. Its last two bytes must be '\0'.
+                                                                               // yytext will point into this buffer.
+    void yy_delete_buffer(YY_BUFFER_STATE buffer, yyscan_t scanner);           // Release a buffer handle (the buffer memory itself is not freed)
 }
 #endif
 #endif
@@ -1,10 +1,17 @@
 #include "database.h"
+#include "setupini_index.h"
+#include "catalog_cache.h"
 #include <cerrno>
 #include <fstream>
 #include "utils.h"
 
 const char *DATABASE_NAME = "./cygpm.db";
 const char *DATABASE_JOURNAL = "./cygpm.db-journal";
+const char *SETUPINI_NAME = "../test/setup.ini";
+const char *SETUPINI_INDEX_NAME = "./cygpm.idx";
+const char *DEPENDENCY_GRAPH_NAME = "./cygpm.graph";
+const char *CATALOG_CACHE_NAME = "./cygpm.cache";
+const char *INSTALLED_DB_NAME = "/etc/setup/installed.db";
 
 void removeOldDatabase();
 
@@ -19,16 +26,119 @@ int main()
         return -1;
     }
 #if 1
-    db.createTable();
-    db.parseAndBuildDatabase("../test/setup.ini");
-    db.buildDependencyMap();
+    if (!db.isUpToDate(SETUPINI_NAME)) // Skip rebuilding if mirror's setup.ini is unchanged
+    {
+        SetupIniIndex::build(SETUPINI_NAME, SETUPINI_INDEX_NAME); // Index is quick to build, and answers lookups before database is ready
+
+        db.applyProfile(DB_PROFILE_BULK_BUILD);
+        db.setIncrementalBuild(true); // Only rewrite packages whose block changed
+        db.createTable();
+        db.setParseMode(PARSE_MODE_MMAP);
+        db.parseAndBuildDatabase(SETUPINI_NAME);
+        db.buildDependencyMap();
+        db.createIndexes(); // Deferred until all data is loaded. A full rebuild has created them before committing
+        db.applyProfile(DB_PROFILE_SERVING);
+
+        db.saveDependencyGraph(DEPENDENCY_GRAPH_NAME);
+        db.saveCatalogCache(CATALOG_CACHE_NAME);
+    }
+    else
+    {
+        if (db.loadDependencyGraph(DEPENDENCY_GRAPH_NAME) != CPM_OK)
+            db.saveDependencyGraph(DEPENDENCY_GRAPH_NAME); // Builds it from database
+
+        CatalogCache cache;
+        if (cache.open(CATALOG_CACHE_NAME, SETUPINI_NAME) != CPM_OK)
+            db.saveCatalogCache(CATALOG_CACHE_NAME);
+    }
 
     cout << "Added " << db.getNumPackages() << " packages" << endl;
 #endif
 
-    cout << db.getInstallPakSHA512("bash", NULL) << endl;
+    SetupIniIndex index;
+    if (index.open(SETUPINI_NAME, SETUPINI_INDEX_NAME) == CPM_OK)
+        cout << index.getShortDesc("bash") << endl;
+
+    /**
+     * A command needing only a package's metadata can answer from the catalog cache, without SQLite
+     */
+    CatalogCache cache;
+    CatalogCache::Package bash;
+    if (cache.open(CATALOG_CACHE_NAME, SETUPINI_NAME) == CPM_OK && cache.lookup("bash", bash))
+    {
+        cout << bash.name << " " << bash.version << ", " << bash.install.size << " bytes, depends on:";
+        for (uint32_t dependency : cache.getDependencies(cache.find("bash")))
+            cout << " " << cache.getName(dependency);
+        cout << endl;
+    }
+
+    /**
+     * Search packages about "shell". Lookups like this can be served by read-only connections,
+     * in as many processes as needed
+     */
+    CygpmDatabase reader(DATABASE_NAME, DB_OPEN_READ_ONLY);
+    vector<SearchResult> search_results;
+    reader.searchPackages("shell", 5, search_results);
+    for (auto &result : search_results)
+        cout << result.pkg_name << ": " << result.snippet << endl;
+
+    /**
+     * Install order of bash, resolved on the dependency graph
+     */
+    const DependencyGraph &graph = db.getDependencyGraph();
+    vector<uint32_t> install_order;
+    graph.closure(graph.findNode("bash"), install_order);
+    graph.sortTopologically(install_order);
+
+    vector<string> install_names;
+    for (uint32_t node : install_order)
+        install_names.push_back(string(graph.getName(node)));
+
+    vector<PackageRecord> install_plan; // Fetched in one query, not one per column per package
+    db.getPackageRecords(install_names, NULL, install_plan);
+
+    sqlite3_int64 download_size = 0;
+    for (auto &record : install_plan)
+    {
+        cout << record.pkg_name << " " << record.version << " ";
+        if (record.install.size > 0)
+            download_size += record.install.size;
+    }
+    cout << endl
+         << "Download size: " << download_size << " bytes" << endl;
+
+    if (!install_plan.empty())
+        cout << install_plan.back().install.sha512 << endl; // bash itself comes last
     cout << calculateFileSHA512("../test/bash-4.4.12-3.tar.xz") << endl;
 
+    /**
+     * Versions compare as Cygwin versions, not as text: 4.4.12-3 is newer than 4.4.9-10
+     */
+    vector<string> bash_versions = db.getVersionsInRange("bash", "4.4", NULL);
+    cout << "bash 4.4 and later:";
+    for (auto &version : bash_versions)
+        cout << " " << version;
+    cout << endl;
+
+    /**
+     * Removing a package breaks whatever depends on it. Then report packages which
+     * were installed as dependencies, but no manually installed package needs any more
+     */
+    vector<string> dependents;
+    db.findDependents(dependents, "libncursesw10");
+    size_t numAffected = dependents.empty() ? 0 : dependents.size() - 1; // Listed with the package itself, unless lookup failed
+    cout << "Removing libncursesw10 affects " << numAffected << " packages" << endl;
+
+    vector<InstalledPackage> installed;
+    vector<string> orphans;
+    if (readInstalledDb(INSTALLED_DB_NAME, installed) == CPM_OK && db.findOrphans(installed, orphans) == 0)
+    {
+        cout << orphans.size() << " of " << installed.size() << " installed packages are orphans:";
+        for (auto &orphan : orphans)
+            cout << " " << orphan;
+        cout << endl;
+    }
+
     //cout << decompressGzipFileData("../test/cmake.lst.gz") << endl;
 
     return 0;
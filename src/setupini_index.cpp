@@ -0,0 +1,251 @@
+#include "setupini_index.h"
+
+#include <sys/stat.h>
+
+static const char INDEX_MAGIC[8] = {'C', 'P', 'M', 'I', 'D', 'X', '1', '\0'};
+
+/**
+ * Characters of a package name, the same as PACKAGE_NAME in setupini.l
+ */
+static inline bool isPackageNameChar(char c)
+{
+    return isalnum((unsigned char)c) || c == '-' || c == '+' || c == '_' || c == '.';
+}
+
+SetupIniIndex::SetupIniIndex()
+{
+}
+
+SetupIniIndex::~SetupIniIndex()
+{
+    close();
+}
+
+int SetupIniIndex::build(const char *setupini_fileName, const char *index_fileName)
+{
+    struct stat st;
+    if (stat(setupini_fileName, &st) != 0)
+        return CPM_FILE_NOT_EXIST;
+
+    // Offsets are taken from the file itself, so it must not be compressed
+    if (detectCompression(setupini_fileName) != COMPRESSION_NONE)
+    {
+        cerr << "Error while building index: " << setupini_fileName << " is compressed" << endl;
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    MappedFile file;
+    int rc = mapFileForScan(setupini_fileName, file);
+    if (rc != CPM_OK)
+        return rc;
+
+    /**
+     * Find package lines ("@ ..."), the same ones splitIntoShards() splits at: A package line follows a blank line,
+     * and is not inside a quoted string, so "@ " in a quoted ldesc is not mistaken for a package.
+     * Each block ends where the next one starts.
+     */
+    vector<Entry> index;
+    string name_pool;
+    const char *data = file.data;
+    PackageBoundaryScanner boundaries(data, file.size);
+
+    for (size_t pos = boundaries.next(0); pos < file.size; pos = boundaries.next(pos + 1))
+    {
+        size_t name_start = pos + 2, name_end = pos + 2;
+        while (name_end < file.size && isPackageNameChar(data[name_end]))
+            name_end++;
+        if (name_end == name_start)
+            continue;
+
+        if (!index.empty())
+            index.back().block_size = pos - index.back().block_offset;
+
+        index.push_back({(uint32_t)name_pool.length(), (uint32_t)(name_end - name_start), pos, 0});
+        name_pool.append(data + name_start, name_end - name_start);
+    }
+
+    if (!index.empty())
+        index.back().block_size = file.size - index.back().block_offset;
+
+    unmapFile(file);
+
+    /**
+     * Sort by name, so lookups can binary search
+     */
+    stable_sort(index.begin(), index.end(), [&](const Entry &a, const Entry &b) {
+        return string_view(name_pool.data() + a.name_offset, a.name_length) < string_view(name_pool.data() + b.name_offset, b.name_length);
+    });
+
+    /**
+     * Write index. Write to a temporary file first, so a reader never sees a partial index.
+     */
+    FileHeader header = {};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.setupini_size = st.st_size;
+    header.setupini_mtime = st.st_mtime;
+    header.num_entries = index.size();
+
+    string tmp_fileName = string(index_fileName) + ".tmp";
+    FILE *out = fopen(tmp_fileName.c_str(), "wb");
+    if (out == NULL)
+    {
+        cerr << "Error while building index: Cannot write " << tmp_fileName << endl;
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              (index.empty() || fwrite(index.data(), sizeof(Entry), index.size(), out) == index.size()) &&
+              (name_pool.empty() || fwrite(name_pool.data(), 1, name_pool.length(), out) == name_pool.length());
+    ok = fclose(out) == 0 && ok;
+
+    if (!ok || rename(tmp_fileName.c_str(), index_fileName) != 0)
+    {
+        cerr << "Error while building index: Cannot write " << index_fileName << endl;
+        remove(tmp_fileName.c_str());
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    cerr << "> Indexed " << index.size() << " packages" << endl;
+
+    return CPM_OK;
+}
+
+int SetupIniIndex::open(const char *setupini_fileName, const char *index_fileName)
+{
+    close();
+
+    int rc = mapFileForScan(index_fileName, indexFile);
+    if (rc != CPM_OK)
+        return rc;
+
+    /**
+     * Validate index: the name pool must hold exactly every entry's name,
+     * and every name & block must lie within the name pool & setup.ini
+     */
+    const FileHeader *header = (const FileHeader *)indexFile.data;
+    bool valid = indexFile.size >= sizeof(FileHeader) && memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+                 indexFile.size >= sizeof(FileHeader) + (size_t)header->num_entries * sizeof(Entry);
+    if (valid)
+    {
+        const Entry *file_entries = (const Entry *)(indexFile.data + sizeof(FileHeader));
+        size_t name_pool_size = indexFile.size - sizeof(FileHeader) - (size_t)header->num_entries * sizeof(Entry);
+        uint64_t names_size = 0;
+        for (uint32_t i = 0; i < header->num_entries && valid; i++)
+        {
+            const Entry &entry = file_entries[i];
+            names_size += entry.name_length;
+            valid = (uint64_t)entry.name_offset + entry.name_length <= name_pool_size &&
+                    entry.block_offset <= header->setupini_size && entry.block_size <= header->setupini_size - entry.block_offset;
+        }
+        valid = valid && names_size == name_pool_size;
+    }
+
+    if (!valid)
+    {
+        cerr << "Broken index: " << index_fileName << endl;
+        close();
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    struct stat st;
+    if (stat(setupini_fileName, &st) != 0 || (uint64_t)st.st_size != header->setupini_size || (int64_t)st.st_mtime != header->setupini_mtime)
+    {
+        close();
+        return CPM_INDEX_OUTDATED;
+    }
+
+    entries = (const Entry *)(indexFile.data + sizeof(FileHeader));
+    numEntries = header->num_entries;
+    names = (const char *)(entries + numEntries);
+
+    setupini = fopen(setupini_fileName, "rb");
+    if (setupini == NULL)
+    {
+        close();
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    return CPM_OK;
+}
+
+void SetupIniIndex::close()
+{
+    if (indexFile.data != NULL)
+        unmapFile(indexFile);
+    if (setupini != NULL)
+        fclose(setupini);
+
+    delete lastBlock;
+
+    entries = NULL;
+    names = NULL;
+    numEntries = 0;
+    setupini = NULL;
+    lastBlock = NULL;
+}
+
+const SetupIniIndex::Entry *SetupIniIndex::find(string_view pkg_name)
+{
+    const Entry *found = lower_bound(entries, entries + numEntries, pkg_name, [&](const Entry &entry, string_view name) {
+        return string_view(names + entry.name_offset, entry.name_length) < name;
+    });
+
+    if (found == entries + numEntries || string_view(names + found->name_offset, found->name_length) != pkg_name)
+        return NULL;
+
+    return found;
+}
+
+bool SetupIniIndex::lookup(const char *pkg_name, PackageInfoView &pkg_info)
+{
+    const Entry *entry = find(pkg_name);
+    if (entry == NULL || setupini == NULL)
+        return false;
+
+    /**
+     * Read the block, then parse it as a one-package shard
+     */
+    blockBuffer.resize(entry->block_size + 2);
+    if (fseeko(setupini, entry->block_offset, SEEK_SET) != 0 || fread(blockBuffer.data(), 1, entry->block_size, setupini) != entry->block_size)
+        return false;
+
+    blockBuffer[entry->block_size] = '\0';
+    blockBuffer[entry->block_size + 1] = '\0';
+
+    delete lastBlock;
+    lastBlock = new SetupIniShard;
+    lastBlock->base = blockBuffer.data();
+    lastBlock->size = blockBuffer.size();
+    parseShard(*lastBlock);
+
+    if (lastBlock->failed)
+        return false;
+
+    bool found = false;
+    lastBlock->packages.forEach([&](const PackageInfoView &parsed) {
+        if (!found && parsed.pkg_name == pkg_name)
+        {
+            pkg_info = parsed;
+            found = true;
+        }
+    });
+
+    return found;
+}
+
+string SetupIniIndex::getShortDesc(const char *pkg_name)
+{
+    PackageInfoView pkg_info;
+    return lookup(pkg_name, pkg_info) ? string(pkg_info.sdesc) : string();
+}
+
+string SetupIniIndex::getLongDesc(const char *pkg_name)
+{
+    PackageInfoView pkg_info;
+    return lookup(pkg_name, pkg_info) ? string(pkg_info.ldesc) : string();
+}
+
+size_t SetupIniIndex::getNumPackages()
+{
+    return numEntries;
+}
@@ -0,0 +1,65 @@
+/**
+ * setupini_index.h  //  Package offset index of setup.ini.
+ *
+ * A compact file listing every package's name and the byte range of its "@ package" block
+ * in setup.ini, sorted by name. A lookup is a binary search plus parsing that single block,
+ * so a package can be viewed right after setup.ini is downloaded, without the database.
+ *
+ * The index records setup.ini's size and modification time, and refuses to be used with
+ * any other setup.ini. It's a local cache, so it's written in native byte order.
+ */
+
+#ifndef SETUPINI_INDEX_H
+#define SETUPINI_INDEX_H
+
+#include "database.h"
+
+using namespace std;
+
+class SetupIniIndex
+{
+private:
+    struct FileHeader
+    {
+        char magic[8];          // INDEX_MAGIC
+        uint64_t setupini_size; // Size & modification time of setup.ini this index is built from
+        int64_t setupini_mtime;
+        uint32_t num_entries;
+        uint32_t reserved; // Always 0
+    };
+
+    struct Entry
+    {
+        uint32_t name_offset;  // Package name's position in the name pool, which follows the entries
+        uint32_t name_length;
+        uint64_t block_offset; // Package block's position in setup.ini
+        uint64_t block_size;
+    };
+
+    MappedFile indexFile;            // The whole index file
+    const Entry *entries = NULL;     // Sorted by name
+    const char *names = NULL;        // Name pool
+    size_t numEntries = 0;
+    FILE *setupini = NULL;           // To read blocks from
+    vector<char> blockBuffer;        // Block of the last lookup, scanned in place
+    SetupIniShard *lastBlock = NULL; // Records parsed from blockBuffer
+
+public:
+    SetupIniIndex();
+    ~SetupIniIndex();
+
+    static int build(const char *setupini_fileName, const char *index_fileName); // Scan setup.ini's package lines, then write an index
+
+    int open(const char *setupini_fileName, const char *index_fileName); // Load an index, checking it matches setup.ini
+    void close();
+
+    bool lookup(const char *pkg_name, PackageInfoView &pkg_info); // Parse a package's block. Views are valid until the next lookup() or close()
+    string getShortDesc(const char *pkg_name);                    // Empty if package doesn't exist
+    string getLongDesc(const char *pkg_name);
+    size_t getNumPackages();
+
+private:
+    const Entry *find(string_view pkg_name); // Binary search. NULL if not found
+};
+
+#endif
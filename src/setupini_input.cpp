@@ -0,0 +1,432 @@
+#include "setupini_input.h"
+
+#include <climits>
+
+const size_t IN_BUFFER_SIZE = 64 * 1024; // Compressed data chunk size
+
+CompressionType detectCompression(const char *fileName)
+{
+    unsigned char magic[6] = {0};
+
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL)
+        return COMPRESSION_NONE;
+
+    size_t n = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+
+    if (n >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+        return COMPRESSION_GZIP;
+    if (n >= 6 && memcmp(magic, "\xFD" "7zXZ\0", 6) == 0)
+        return COMPRESSION_XZ;
+    if (n >= 3 && memcmp(magic, "BZh", 3) == 0)
+        return COMPRESSION_BZIP2;
+    if (n >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+        return COMPRESSION_ZSTD;
+
+    return COMPRESSION_NONE;
+}
+
+SetupIniReader::SetupIniReader()
+{
+    lexerInput.read = readCallback;
+    lexerInput.source = this;
+}
+
+SetupIniReader::~SetupIniReader()
+{
+    close();
+}
+
+int SetupIniReader::open(const char *fileName)
+{
+    close();
+
+    compression = detectCompression(fileName);
+    hasError = false;
+
+    file = fopen(fileName, "rb");
+    if (file == NULL)
+        return CPM_FILE_ACCESS_ERROR;
+
+    if (compression == COMPRESSION_NONE)
+        return CPM_OK;
+
+    in_buffer = new char[IN_BUFFER_SIZE];
+
+    /**
+     * Initialize decompressor
+     */
+    int rc = 0;
+    switch (compression)
+    {
+    case COMPRESSION_GZIP:
+        memset(&zs, 0, sizeof(zs));
+        rc = inflateInit2(&zs, 15 + 32) == Z_OK ? 0 : -1; // 15 + 32: Max window size, detect gzip/zlib header automatically
+        break;
+    case COMPRESSION_XZ:
+        xzs = LZMA_STREAM_INIT;
+        rc = lzma_stream_decoder(&xzs, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK ? 0 : -1;
+        break;
+    case COMPRESSION_BZIP2:
+        memset(&bzs, 0, sizeof(bzs));
+        rc = BZ2_bzDecompressInit(&bzs, 0, 0) == BZ_OK ? 0 : -1;
+        break;
+    case COMPRESSION_ZSTD:
+#ifdef CYGPM_WITH_ZSTD
+        zds = ZSTD_createDStream();
+        zin = {in_buffer, 0, 0};
+        rc = zds != NULL && !ZSTD_isError(ZSTD_initDStream(zds)) ? 0 : -1;
+#else
+        cerr << "zstd support is not compiled in. Rebuild with WITH_ZSTD=1" << endl;
+        rc = -1;
+#endif
+        break;
+    default:
+        break;
+    }
+
+    if (rc != 0)
+    {
+        close();
+        return CPM_DECOMPRESS_ERROR;
+    }
+
+    return CPM_OK;
+}
+
+void SetupIniReader::close()
+{
+    if (file == NULL)
+        return;
+
+    switch (compression)
+    {
+    case COMPRESSION_GZIP:
+        inflateEnd(&zs);
+        break;
+    case COMPRESSION_XZ:
+        lzma_end(&xzs);
+        break;
+    case COMPRESSION_BZIP2:
+        BZ2_bzDecompressEnd(&bzs);
+        break;
+    case COMPRESSION_ZSTD:
+#ifdef CYGPM_WITH_ZSTD
+        ZSTD_freeDStream(zds);
+        zds = NULL;
+#endif
+        break;
+    default:
+        break;
+    }
+
+    fclose(file);
+    file = NULL;
+
+    delete[] in_buffer;
+    in_buffer = NULL;
+    in_eof = false;
+    stream_end = false;
+}
+
+size_t SetupIniReader::fillInput()
+{
+    size_t n = fread(in_buffer, 1, IN_BUFFER_SIZE, file);
+    if (n < IN_BUFFER_SIZE)
+        in_eof = true;
+
+    return n;
+}
+
+int SetupIniReader::read(char *buffer, int max_size)
+{
+    if (file == NULL || hasError)
+        return -1;
+
+    /**
+     * Plain text: Read directly
+     */
+    if (compression == COMPRESSION_NONE)
+        return fread(buffer, 1, max_size, file);
+
+    /**
+     * Compressed: Decompress into buffer until it's full, or the stream ends.
+     * Every decompressor is driven the same way: Refill input when it's drained, then step.
+     */
+    size_t produced = 0;
+    while (produced < (size_t)max_size && !stream_end)
+    {
+        char *out = buffer + produced;
+        size_t avail_out = max_size - produced;
+        size_t produced_before = produced;
+        bool input_drained; // No more compressed data before this step
+
+        switch (compression)
+        {
+        case COMPRESSION_GZIP:
+        {
+            if (zs.avail_in == 0 && !in_eof)
+            {
+                zs.avail_in = fillInput();
+                zs.next_in = (Bytef *)in_buffer;
+            }
+            input_drained = zs.avail_in == 0 && in_eof;
+
+            zs.next_out = (Bytef *)out;
+            zs.avail_out = avail_out;
+            int rc = inflate(&zs, Z_NO_FLUSH);
+            produced += avail_out - zs.avail_out;
+
+            if (rc == Z_STREAM_END)
+                stream_end = true;
+            else if (rc != Z_OK && rc != Z_BUF_ERROR) // Z_BUF_ERROR: No progress, checked below
+                hasError = true;
+            break;
+        }
+        case COMPRESSION_XZ:
+        {
+            if (xzs.avail_in == 0 && !in_eof)
+            {
+                xzs.avail_in = fillInput();
+                xzs.next_in = (const uint8_t *)in_buffer;
+            }
+            input_drained = xzs.avail_in == 0 && in_eof;
+
+            xzs.next_out = (uint8_t *)out;
+            xzs.avail_out = avail_out;
+            lzma_ret rc = lzma_code(&xzs, input_drained ? LZMA_FINISH : LZMA_RUN);
+            produced += avail_out - xzs.avail_out;
+
+            if (rc == LZMA_STREAM_END)
+                stream_end = true;
+            else if (rc != LZMA_OK)
+                hasError = true;
+            break;
+        }
+        case COMPRESSION_BZIP2:
+        {
+            if (bzs.avail_in == 0 && !in_eof)
+            {
+                bzs.avail_in = fillInput();
+                bzs.next_in = in_buffer;
+            }
+            input_drained = bzs.avail_in == 0 && in_eof;
+
+            bzs.next_out = out;
+            bzs.avail_out = avail_out;
+            int rc = BZ2_bzDecompress(&bzs);
+            produced += avail_out - bzs.avail_out;
+
+            if (rc == BZ_STREAM_END)
+                stream_end = true;
+            else if (rc != BZ_OK)
+                hasError = true;
+            break;
+        }
+#ifdef CYGPM_WITH_ZSTD
+        case COMPRESSION_ZSTD:
+        {
+            if (zin.pos == zin.size && !in_eof)
+                zin = {in_buffer, fillInput(), 0};
+            input_drained = zin.pos == zin.size && in_eof;
+
+            ZSTD_outBuffer zout = {out, avail_out, 0};
+            size_t rc = ZSTD_decompressStream(zds, &zout, &zin);
+            produced += zout.pos;
+
+            if (ZSTD_isError(rc))
+                hasError = true;
+            else if (rc == 0 && input_drained)
+                stream_end = true;
+            break;
+        }
+#endif
+        default:
+            hasError = true;
+        }
+
+        if (hasError)
+        {
+            cerr << "Failed to decompress setup.ini" << endl;
+            return -1;
+        }
+
+        /* Input is used up but the stream didn't end: File is truncated */
+        if (input_drained && !stream_end && produced == produced_before)
+        {
+            cerr << "Failed to decompress setup.ini: Unexpected end of file" << endl;
+            hasError = true;
+            return -1;
+        }
+    }
+
+    return produced;
+}
+
+int SetupIniReader::readCallback(void *source, char *buffer, int max_size)
+{
+    return ((SetupIniReader *)source)->read(buffer, max_size);
+}
+
+CompressionType SetupIniReader::getCompression()
+{
+    return compression;
+}
+
+bool SetupIniReader::getHasError()
+{
+    return hasError;
+}
+
+SetupIniInput *SetupIniReader::getLexerInput()
+{
+    return &lexerInput;
+}
+
+int loadSetupIniForScan(const char *fileName, MappedFile &setupini)
+{
+    if (detectCompression(fileName) == COMPRESSION_NONE)
+        return mapFileForScan(fileName, setupini);
+
+    /**
+     * Compressed: Decompress the whole stream into a heap buffer.
+     * No temporary file is written.
+     */
+    SetupIniReader reader;
+    int rc = reader.open(fileName);
+    if (rc != CPM_OK)
+        return rc;
+
+    size_t capacity = 16 * 1024 * 1024; // Enough for a full setup.ini in most cases
+    size_t size = 0;
+    char *data = new char[capacity + 2];
+
+    for (;;)
+    {
+        if (size == capacity)
+        {
+            char *larger = new char[capacity * 2 + 2];
+            memcpy(larger, data, size);
+            delete[] data;
+            data = larger;
+            capacity *= 2;
+        }
+
+        int n = reader.read(data + size, min(capacity - size, (size_t)INT_MAX));
+        if (n < 0)
+        {
+            delete[] data;
+            return CPM_DECOMPRESS_ERROR;
+        }
+        if (n == 0)
+            break;
+
+        size += n;
+    }
+
+    data[size] = '\0';
+    data[size + 1] = '\0';
+
+    setupini.data = data;
+    setupini.size = size;
+    setupini.is_mapped = false;
+
+    return CPM_OK;
+}
+
+const char *SETUP_INI_HEADER_KEYS[NUM_HEADER_FIELDS] = {
+    "release",
+    "arch",
+    "setup-timestamp",
+    "setup-minimum-version",
+    "setup-version",
+};
+
+string *SetupIniHeader::selectField(const char *key, size_t length)
+{
+    for (int i = 0; i < NUM_HEADER_FIELDS; i++)
+        if (strlen(SETUP_INI_HEADER_KEYS[i]) == length && strncmp(SETUP_INI_HEADER_KEYS[i], key, length) == 0)
+            return &fields[i];
+
+    return NULL;
+}
+
+bool SetupIniHeader::operator==(const SetupIniHeader &other) const
+{
+    for (int i = 0; i < NUM_HEADER_FIELDS; i++)
+        if (fields[i] != other.fields[i])
+            return false;
+
+    return true;
+}
+
+uint64_t SetupIniHeader::getStamp() const
+{
+    string text;
+    for (auto &field : fields)
+        text += field + '\n';
+
+    return fnv1a64(text.data(), text.length());
+}
+
+int readSetupIniHeader(const char *fileName, SetupIniHeader &header)
+{
+    const size_t MAX_HEADER_SIZE = 64 * 1024; // Real headers are < 1 KB. Don't read further if there's no package
+
+    SetupIniReader reader;
+    int rc = reader.open(fileName);
+    if (rc != CPM_OK)
+        return rc;
+
+    /**
+     * Read (and maybe decompress) until the first package line shows up
+     */
+    string text;
+    char buffer[4096];
+
+    while (text.length() < MAX_HEADER_SIZE && text.find("\n@") == string::npos)
+    {
+        int n = reader.read(buffer, sizeof(buffer));
+        if (n < 0)
+            return CPM_DECOMPRESS_ERROR;
+        if (n == 0)
+            break;
+
+        text.append(buffer, n);
+    }
+
+    /**
+     * Parse "key: value" lines. Words of a value are joined by a single space, the same as the parsers do.
+     */
+    header = SetupIniHeader();
+    istringstream lines(text);
+    string line;
+
+    while (getline(lines, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (line[0] == '@')
+            break;
+
+        size_t colon = line.find(':');
+        if (colon == string::npos)
+            continue;
+
+        string *field = header.selectField(line.c_str(), colon);
+        if (field == NULL)
+            continue;
+
+        istringstream words(line.substr(colon + 1));
+        string word;
+        while (words >> word)
+        {
+            if (!field->empty())
+                *field += ' ';
+            *field += word;
+        }
+    }
+
+    return CPM_OK;
+}
@@ -0,0 +1,117 @@
+/**
+ * setupini_input.h  //  Feed setup.ini into the lexer, decompressing on the fly.
+ *
+ * Mirrors publish setup.ini compressed as setup.xz, setup.zst, setup.bz2 (and sometimes gzip).
+ * Instead of decompressing them to disk, the lexer pulls decompressed chunks
+ * via YY_INPUT, which calls SetupIniInput::read().
+ *
+ * The first part of this header is plain C, as it's shared with the lexer.
+ */
+
+#ifndef SETUPINI_INPUT_H
+#define SETUPINI_INPUT_H
+
+/**
+ * Lexer input source. Installed into a scanner by yyset_extra().
+ * read() returns the count of bytes filled, 0 on EOF, or -1 on error.
+ */
+struct SetupIniInput
+{
+    int (*read)(void *source, char *buffer, int max_size);
+    void *source;
+};
+
+#ifdef __cplusplus
+
+#include "stdafx.hpp"
+#include "utils.h"
+
+#include <zlib.h>
+#include <lzma.h>
+#include <bzlib.h>
+#ifdef CYGPM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+enum CompressionType
+{
+    COMPRESSION_NONE = 0,
+    COMPRESSION_GZIP,
+    COMPRESSION_XZ,
+    COMPRESSION_BZIP2,
+    COMPRESSION_ZSTD
+};
+
+CompressionType detectCompression(const char *fileName); // Detect compression by magic number
+
+class SetupIniReader
+{
+private:
+    FILE *file = NULL;                              // Underlying (maybe compressed) file
+    CompressionType compression = COMPRESSION_NONE; // Detected compression
+    SetupIniInput lexerInput;                       // Handed to the lexer
+    bool hasError = false;                          // Decompression failed, or input is truncated
+
+    char *in_buffer = NULL;  // Compressed data read from file
+    bool in_eof = false;     // No more compressed data in file
+    bool stream_end = false; // Decompressor reported the end of stream
+
+    z_stream zs;     // gzip
+    lzma_stream xzs; // xz
+    bz_stream bzs;   // bzip2
+#ifdef CYGPM_WITH_ZSTD
+    ZSTD_DStream *zds = NULL; // zstd
+    ZSTD_inBuffer zin;
+#endif
+
+public:
+    SetupIniReader();
+    ~SetupIniReader();
+
+    int open(const char *fileName);       // Open a plain or compressed setup.ini
+    void close();                         // Close file & release decompressor
+    int read(char *buffer, int max_size); // Read decompressed data. Return 0 on EOF, -1 on error
+
+    CompressionType getCompression();
+    bool getHasError();
+    SetupIniInput *getLexerInput(); // Input source for yyset_extra()
+
+private:
+    size_t fillInput(); // Refill in_buffer from file. Return bytes read
+    static int readCallback(void *source, char *buffer, int max_size);
+};
+
+/**
+ * setup.ini's header: YAML items before the first package.
+ * Mirrors regenerate setup.ini with a new setup-timestamp, so an unchanged header means an unchanged catalog.
+ */
+enum SetupIniHeaderField
+{
+    HEADER_RELEASE = 0,
+    HEADER_ARCH,
+    HEADER_SETUP_TIMESTAMP,
+    HEADER_SETUP_MINIMUM_VERSION,
+    HEADER_SETUP_VERSION,
+    NUM_HEADER_FIELDS
+};
+
+extern const char *SETUP_INI_HEADER_KEYS[NUM_HEADER_FIELDS]; // Header keys, without ':'
+
+struct SetupIniHeader
+{
+    string fields[NUM_HEADER_FIELDS]; // Indexed by SetupIniHeaderField
+
+    string *selectField(const char *key, size_t length); // Locate the field of a key (without ':'), or NULL if we don't store it
+    bool operator==(const SetupIniHeader &other) const;
+    uint64_t getStamp() const; // Fingerprint of all fields. Caches built from a catalog record it
+};
+
+int readSetupIniHeader(const char *fileName, SetupIniHeader &header); // Read the header only, stopping at the first package
+
+int loadSetupIniForScan(const char *fileName, MappedFile &setupini); // Map a plain setup.ini, or decompress a compressed one into memory.
+                                                                    // Either way, the result is scannable in place by yy_scan_buffer().
+
+#endif
+#endif
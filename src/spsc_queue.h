@@ -0,0 +1,117 @@
+/**
+ * spsc_queue.h  //  Bounded lock-free queue between one producer thread and one consumer thread.
+ *
+ * Items live in a fixed ring of slots, and are filled & drained in place: The producer takes
+ * a free slot, fills it, then publishes it. The consumer reads the oldest published slot,
+ * then hands it back. So a slot (and whatever buffers it owns) is reused, never copied or freed.
+ *
+ * Each index is written by one thread only, so no lock or compare-and-swap is needed.
+ * The blocking calls spin, yielding the CPU, then sleep briefly if the wait goes on.
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include "stdafx.hpp"
+
+using namespace std;
+
+template <typename T>
+class SPSCQueue
+{
+private:
+    vector<T> slots;
+    alignas(64) atomic<size_t> head{0}; // Count of items popped. Written by consumer only
+    alignas(64) atomic<size_t> tail{0}; // Count of items pushed. Written by producer only
+    atomic<bool> closed{false};         // Producer has pushed its last item
+
+    static void backoff(int &numTries)
+    {
+        if (++numTries < 64)
+            this_thread::yield();
+        else
+            this_thread::sleep_for(chrono::microseconds(50));
+    }
+
+public:
+    explicit SPSCQueue(size_t capacity) : slots(capacity) {}
+    SPSCQueue(const SPSCQueue &) = delete;
+    SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+    /**
+     * Producer side
+     */
+    T *tryAcquire() // A free slot to fill. NULL if the queue is full
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == slots.size())
+            return NULL;
+        return &slots[t % slots.size()];
+    }
+
+    T *acquire() // Ditto, waiting until a slot is free
+    {
+        T *slot;
+        for (int numTries = 0; (slot = tryAcquire()) == NULL;)
+            backoff(numTries);
+        return slot;
+    }
+
+    void push() // Publish the slot got from tryAcquire() / acquire()
+    {
+        tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    void close() // No more items. The consumer still gets all pushed ones
+    {
+        closed.store(true, memory_order_release);
+    }
+
+    /**
+     * Consumer side
+     */
+    T *tryFront() // The oldest item. NULL if the queue is empty
+    {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire))
+            return NULL;
+        return &slots[h % slots.size()];
+    }
+
+    T *front() // Ditto, waiting until an item is pushed. NULL if the queue is closed & drained
+    {
+        T *slot;
+        for (int numTries = 0; (slot = tryFront()) == NULL; backoff(numTries))
+        {
+            if (closed.load(memory_order_acquire))
+                return tryFront(); // Items pushed right before closing
+        }
+        return slot;
+    }
+
+    void pop() // Hand the front slot back to the producer
+    {
+        head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    /**
+     * Either side
+     */
+    size_t size() const // Items waiting, a snapshot
+    {
+        size_t h = head.load(memory_order_acquire); // Head first: tail can only be further then
+        return tail.load(memory_order_acquire) - h;
+    }
+
+    size_t capacity() const
+    {
+        return slots.size();
+    }
+
+    T &slot(size_t i) // Direct access to a slot. Only when neither thread is running
+    {
+        return slots[i];
+    }
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "statement_cursor.h"
+
+StatementCursor::StatementCursor(sqlite3_stmt *statement)
+{
+    stmt = statement;
+    rc = statement != NULL ? SQLITE_OK : SQLITE_ERROR;
+}
+
+StatementCursor::StatementCursor(sqlite3 *db, const char *sql)
+{
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    ownsStatement = true;
+}
+
+StatementCursor::~StatementCursor()
+{
+    if (ownsStatement)
+        sqlite3_finalize(stmt);
+    else if (stmt != NULL)
+        sqlite3_reset(stmt);
+}
+
+bool StatementCursor::next()
+{
+    // Once done (or failed), don't step again: A stepped-over statement would start over
+    if (rc != SQLITE_OK && rc != SQLITE_ROW)
+        return false;
+
+    rc = sqlite3_step(stmt);
+    return rc == SQLITE_ROW;
+}
+
+int StatementCursor::getResult() const
+{
+    return rc;
+}
+
+bool StatementCursor::isDone() const
+{
+    return rc == SQLITE_DONE;
+}
+
+sqlite3_stmt *StatementCursor::getStatement() const
+{
+    return stmt;
+}
+
+int StatementCursor::getType(int column) const
+{
+    return sqlite3_column_type(stmt, column);
+}
+
+bool StatementCursor::isNull(int column) const
+{
+    return getType(column) == SQLITE_NULL;
+}
+
+int StatementCursor::getInt(int column) const
+{
+    return sqlite3_column_int(stmt, column);
+}
+
+sqlite3_int64 StatementCursor::getInt64(int column) const
+{
+    return sqlite3_column_int64(stmt, column);
+}
+
+double StatementCursor::getDouble(int column) const
+{
+    return sqlite3_column_double(stmt, column);
+}
+
+const char *StatementCursor::getCString(int column) const
+{
+    return (const char *)sqlite3_column_text(stmt, column);
+}
+
+string_view StatementCursor::getText(int column) const
+{
+    const char *text = (const char *)sqlite3_column_text(stmt, column);
+    return text != NULL ? string_view(text, sqlite3_column_bytes(stmt, column)) : string_view();
+}
+
+string StatementCursor::getString(int column) const
+{
+    return string(getText(column));
+}
+
+string_view StatementCursor::getBlob(int column) const
+{
+    const char *blob = (const char *)sqlite3_column_blob(stmt, column);
+    return blob != NULL ? string_view(blob, sqlite3_column_bytes(stmt, column)) : string_view();
+}
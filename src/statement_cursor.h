@@ -0,0 +1,52 @@
+/**
+ * statement_cursor.h  //  Row-by-row cursor over a SQLite statement.
+ *
+ * A cursor steps a statement one row at a time, so a query holds one row in memory however large its result is.
+ * Columns are read by typed accessors. Text & blobs are borrowed from the current row (valid until next(),
+ * or until the cursor is gone), unless an owned copy is asked for by getString().
+ *
+ * When the cursor goes out of scope, a registered statement is reset (keeping its bindings) for the next user,
+ * and a statement the cursor prepared itself is finalized. So no return path leaves a statement running.
+ */
+
+#ifndef STATEMENT_CURSOR_H
+#define STATEMENT_CURSOR_H
+
+#include "stdafx.hpp"
+
+using namespace std;
+
+class StatementCursor
+{
+private:
+    sqlite3_stmt *stmt = NULL;
+    bool ownsStatement = false; // Prepared by this cursor, so finalized by it
+    int rc = SQLITE_OK;         // Result of the last prepare or step
+
+public:
+    explicit StatementCursor(sqlite3_stmt *statement); // Step a prepared (and bound) statement. NULL is taken as a failed prepare
+    StatementCursor(sqlite3 *db, const char *sql);     // Prepare a one-off statement, to be bound via getStatement()
+    ~StatementCursor();
+    StatementCursor(const StatementCursor &) = delete;
+    StatementCursor &operator=(const StatementCursor &) = delete;
+
+    bool next();           // Step to the next row. false at the end, or on error
+    int getResult() const; // SQLITE_ROW on a row, SQLITE_DONE at the end, or an error code
+    bool isDone() const;   // Reached the end without error
+    sqlite3_stmt *getStatement() const;
+
+    /**
+     * Columns of current row
+     */
+    int getType(int column) const; // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+    bool isNull(int column) const;
+    int getInt(int column) const;
+    sqlite3_int64 getInt64(int column) const;
+    double getDouble(int column) const;
+    const char *getCString(int column) const; // Borrowed. NULL if the column is NULL
+    string_view getText(int column) const;    // Borrowed. Empty if the column is NULL
+    string getString(int column) const;       // Owned copy. Empty if the column is NULL
+    string_view getBlob(int column) const;    // Borrowed bytes
+};
+
+#endif
@@ -8,10 +8,19 @@
 #include <cctype>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <regex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
 
 #include <sqlite3.h>
 
@@ -0,0 +1,625 @@
+/**
+ * test.cpp  //  Regression tests. Build & run them by `make test`.
+ *
+ * Each test writes the setup.ini (or database) it needs into the current directory,
+ * and removes its files afterwards. A failed check is printed, and makes the exit code non-zero.
+ */
+
+#include "database.h"
+#include "setupini_index.h"
+#include "catalog_cache.h"
+#include <fstream>
+
+static int numFailures = 0;
+
+#define CHECK(condition)                                                                        \
+    do                                                                                          \
+    {                                                                                           \
+        if (!(condition))                                                                       \
+        {                                                                                       \
+            cerr << "FAILED " << __FILE__ << ":" << __LINE__ << ": " << #condition << endl; \
+            numFailures++;                                                                      \
+        }                                                                                       \
+    } while (0)
+
+/**
+ * Helpers
+ */
+static const char *SETUPINI_HEADER = "release: cygwin\n"
+                                     "arch: x86_64\n"
+                                     "setup-timestamp: 1570126036\n"
+                                     "setup-version: 2.897\n"
+                                     "\n";
+
+static void writeFile(const char *fileName, const string &text)
+{
+    ofstream file(fileName, ios::binary);
+    file << text;
+}
+
+static void removeDatabase(const char *fileName)
+{
+    remove(fileName);
+    remove((string(fileName) + "-wal").c_str());
+    remove((string(fileName) + "-shm").c_str());
+}
+
+static vector<string> queryRows(const char *db_fileName, const char *sql) // Each row's columns, joined by '|'
+{
+    vector<string> rows;
+    sqlite3 *db;
+
+    if (sqlite3_open_v2(db_fileName, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK)
+    {
+        StatementCursor cursor(db, sql);
+        while (cursor.next())
+        {
+            string row;
+            for (int i = 0; i < sqlite3_column_count(cursor.getStatement()); i++)
+                row += (i == 0 ? "" : "|") + cursor.getString(i);
+            rows.push_back(row);
+        }
+        CHECK(cursor.isDone());
+    }
+
+    sqlite3_close(db);
+    return rows;
+}
+
+static void buildDatabase(const char *db_fileName, const char *setupini_fileName, ParseMode mode)
+{
+    removeDatabase(db_fileName);
+
+    CygpmDatabase db(db_fileName);
+    db.createTable();
+    db.setParseMode(mode);
+    db.setParseThreads(2);
+    CHECK(db.parseAndBuildDatabase(setupini_fileName) >= 0);
+}
+
+/**
+ * All parse modes store the same rows. Words of an unquoted item are joined by a single space,
+ * however they're separated in setup.ini. A quoted ldesc in the middle holds blank lines followed by "@ ",
+ * which parallel mode (and the index) must not take for package boundaries. Another ldesc has a quote
+ * inside a word, which opens no string
+ */
+static void testParseModesAgree()
+{
+    const char *SETUPINI_NAME = "test_modes.ini";
+    const char *INDEX_NAME = "test_modes.idx";
+    const char *DATABASE_NAMES[] = {"test_stream.db", "test_mmap.db", "test_parallel.db"};
+    const ParseMode MODES[] = {PARSE_MODE_STREAM, PARSE_MODE_MMAP, PARSE_MODE_PARALLEL};
+
+    string setupini = SETUPINI_HEADER;
+    string quoted_ldesc = "\"A quoted description";
+    for (int i = 0; i < 100; i++) // Long enough to span the middle of setup.ini
+        quoted_ldesc += "\n\n@ not-a-package " + to_string(i);
+    quoted_ldesc += "\"";
+
+    for (int i = 0; i < 40; i++) // Enough packages for two shards
+    {
+        string name = "pkg" + to_string(i);
+        setupini += "@ " + name + "\n"
+                    "sdesc: \"Quoted  words, kept  as they are\"\n" +
+                    (i == 20   ? "ldesc: " + quoted_ldesc + "\n"
+                     : i == 10 ? "ldesc: An unquoted description, it\"s\n"
+                                 "  continued on the next line\n"
+                               : "ldesc: An unquoted description\n"
+                                 "  continued on the next line,\tafter a tab\n") +
+                    "category: Base  Devel\n"
+                    "requires: cygwin   libfoo\tlibbar\n"
+                    "version: 1.0-" + to_string(i) + "\n"
+                    "install: x86_64/release/" + name + "/" + name + ".tar.xz 123 abcd\n"
+                    "depends2: cygwin,  libfoo\n"
+                    "[prev]\n"
+                    "version: 0.9-1\n"
+                    "depends2: cygwin\n"
+                    "\n";
+    }
+    writeFile(SETUPINI_NAME, setupini);
+
+    const char *SQL_DUMP_VERSIONS = R"(
+        SELECT N.NAME, P.SDESC, P.LDESC, P.CATEGORY, V.VERSION, V.IS_CURRENT, V.REQUIRES__RAW, V.DEPENDS2__RAW,
+               V.INSTALL_PAK_PATH, V.INSTALL_PAK_SIZE, hex(V.INSTALL_PAK_SHA512)
+        FROM "PACKAGE_NAMES" N JOIN "PACKAGES" P ON P.ID = N.ID JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID
+        ORDER BY N.NAME, V.VERSION;
+    )";
+    const char *SQL_DUMP_DEPENDENCIES = R"(
+        SELECT N.NAME, V.VERSION, DN.NAME
+        FROM "PACKAGE_NAMES" N JOIN "VERSIONS" V ON V.PACKAGE_ID = N.ID
+            JOIN "DEPENDENCIES" D ON D.VERSION_ID = V.ID JOIN "PACKAGE_NAMES" DN ON DN.ID = D.DEPENDS_ON
+        ORDER BY 1, 2, 3;
+    )";
+
+    vector<string> versions[3], dependencies[3];
+    for (int i = 0; i < 3; i++)
+    {
+        buildDatabase(DATABASE_NAMES[i], SETUPINI_NAME, MODES[i]);
+        versions[i] = queryRows(DATABASE_NAMES[i], SQL_DUMP_VERSIONS);
+        dependencies[i] = queryRows(DATABASE_NAMES[i], SQL_DUMP_DEPENDENCIES);
+    }
+
+    CHECK(versions[0].size() == 80);
+    CHECK(!versions[0].empty() && versions[0][0] == "pkg0|\"Quoted  words, kept  as they are\"|"
+                                                   "An unquoted description continued on the next line, after a tab|Base Devel|"
+                                                   "0.9-1|0||cygwin|||");
+    CHECK(versions[1] == versions[0]);
+    CHECK(versions[2] == versions[0]);
+    CHECK(!dependencies[0].empty());
+    CHECK(dependencies[1] == dependencies[0]);
+    CHECK(dependencies[2] == dependencies[0]);
+    CHECK(queryRows(DATABASE_NAMES[2], R"(SELECT count(*) FROM "PACKAGE_NAMES" WHERE NAME = 'not-a-package';)") == vector<string>{"0"});
+    string sql_check_ldesc = R"(SELECT LDESC = ')" + quoted_ldesc + R"(' FROM "PACKAGES" WHERE ID = (SELECT ID FROM "PACKAGE_NAMES" WHERE NAME = 'pkg20');)";
+    CHECK(queryRows(DATABASE_NAMES[2], sql_check_ldesc.c_str()) == vector<string>{"1"});
+
+    CHECK(SetupIniIndex::build(SETUPINI_NAME, INDEX_NAME) == CPM_OK);
+    SetupIniIndex index;
+    CHECK(index.open(SETUPINI_NAME, INDEX_NAME) == CPM_OK);
+    CHECK(index.getNumPackages() == 40);
+    CHECK(index.getShortDesc("pkg39") == "\"Quoted  words, kept  as they are\"");
+    CHECK(index.getShortDesc("not-a-package").empty());
+    index.close();
+
+    // A corrupted index is refused, rather than read out of range
+    {
+        fstream file(INDEX_NAME, ios::in | ios::out | ios::binary);
+        uint64_t huge_block_size = UINT64_MAX;
+        file.seekp(32 + 16); // First entry's block_size, after the 32-byte header
+        file.write((const char *)&huge_block_size, sizeof(huge_block_size));
+    }
+    CHECK(index.open(SETUPINI_NAME, INDEX_NAME) == CPM_FILE_ACCESS_ERROR);
+    CHECK(SetupIniIndex::build(SETUPINI_NAME, INDEX_NAME) == CPM_OK);
+    {
+        ofstream file(INDEX_NAME, ios::app | ios::binary);
+        file << "trailing garbage";
+    }
+    CHECK(index.open(SETUPINI_NAME, INDEX_NAME) == CPM_FILE_ACCESS_ERROR);
+
+    remove(SETUPINI_NAME);
+    remove(INDEX_NAME);
+    for (const char *db_fileName : DATABASE_NAMES)
+        removeDatabase(db_fileName);
+}
+
+/**
+ * A database of schema version 0, with the tables & columns the first catalog had,
+ * is converted on open, keeping its packages, versions & dependencies
+ */
+static void testMigrateBaselineDatabase()
+{
+    const char *DATABASE_NAME = "test_v0.db";
+    const char *SQL_CREATE_V0 = R"(
+        CREATE TABLE "PKG_INFO" (
+            "PKG_NAME" TEXT NOT NULL, "SDESC" TEXT, "LDESC" TEXT, "CATEGORY" TEXT, "REQUIRES__RAW" TEXT, "VERSION" TEXT,
+            "INSTALL_PAK_PATH" TEXT, "INSTALL_PAK_SIZE" TEXT, "INSTALL_PAK_SHA512" TEXT,
+            "SOURCE_PAK_PATH" TEXT, "SOURCE_PAK_SIZE" TEXT, "SOURCE_PAK_SHA512" TEXT, "DEPENDS2__RAW" TEXT,
+            PRIMARY KEY("PKG_NAME")
+        );
+        CREATE TABLE "DEPENDENCY_MAP" (
+            "ID" INTEGER PRIMARY KEY AUTOINCREMENT, "PKG_NAME" TEXT NOT NULL, "VERSION" TEXT NOT NULL, "DEPENDS_ON" TEXT NOT NULL
+        );
+        CREATE TABLE "PREV_VERSIONS" (
+            "PKG_NAME" TEXT NOT NULL, "VERSION" TEXT NOT NULL,
+            "INSTALL_PAK_PATH" TEXT, "INSTALL_PAK_SIZE" TEXT, "INSTALL_PAK_SHA512" TEXT,
+            "SOURCE_PAK_PATH" TEXT, "SOURCE_PAK_SIZE" TEXT, "SOURCE_PAK_SHA512" TEXT, "DEPENDS2__RAW" TEXT
+        );
+
+        INSERT INTO "PKG_INFO" VALUES ('bash', '"The GNU Bourne Again SHell"', 'Bash is an sh-compatible shell', 'Base Shells',
+                                       'cygwin libiconv2', '4.4.12-3 ', 'x86_64/release/bash/bash-4.4.12-3.tar.xz', '1234', 'abcd',
+                                       '', '', '', 'cygwin, libiconv2');
+        INSERT INTO "PKG_INFO" VALUES ('cygwin', '"The UNIX emulation engine"', NULL, 'Base', NULL, '3.0.7-1', NULL, NULL, NULL,
+                                       NULL, NULL, NULL, NULL);
+        INSERT INTO "PREV_VERSIONS" VALUES ('bash', '4.4.11-1', 'x86_64/release/bash/bash-4.4.11-1.tar.xz', '1200', 'ef01',
+                                            NULL, NULL, NULL, 'cygwin');
+        INSERT INTO "DEPENDENCY_MAP" (PKG_NAME, VERSION, DEPENDS_ON) VALUES ('bash', '4.4.12-3 ', 'cygwin');
+        INSERT INTO "DEPENDENCY_MAP" (PKG_NAME, VERSION, DEPENDS_ON) VALUES ('bash', '4.4.12-3 ', 'libiconv2');
+        INSERT INTO "DEPENDENCY_MAP" (PKG_NAME, VERSION, DEPENDS_ON) VALUES ('bash', '4.4.11-1', 'cygwin');
+    )";
+
+    removeDatabase(DATABASE_NAME);
+
+    sqlite3 *db;
+    CHECK(sqlite3_open(DATABASE_NAME, &db) == SQLITE_OK);
+    CHECK(sqlite3_exec(db, SQL_CREATE_V0, NULL, 0, NULL) == SQLITE_OK);
+    sqlite3_close(db);
+
+    {
+        CygpmDatabase catalog(DATABASE_NAME);
+
+        char *version = catalog.getNewestVersion("bash");
+        CHECK(version != NULL && string(version) == "4.4.12-3");
+        free(version);
+
+        char *category = catalog.getCategory("bash");
+        CHECK(category != NULL && string(category) == "Base Shells");
+        free(category);
+
+        char *sha512 = catalog.getInstallPakSHA512("bash", "4.4.11-1");
+        CHECK(sha512 != NULL && string(sha512) == "ef01");
+        free(sha512);
+
+        CHECK(catalog.getPrevVersions("bash") == vector<string>{"4.4.11-1"});
+
+        vector<string> dependencies;
+        CHECK(catalog.findDependencies(dependencies, "bash", "4.4.12-3") >= 0);
+        sort(dependencies.begin(), dependencies.end());
+        CHECK(dependencies == (vector<string>{"bash", "cygwin", "libiconv2"})); // Listed with the package itself
+    }
+
+    CHECK(queryRows(DATABASE_NAME, "PRAGMA user_version;") == vector<string>{to_string(CATALOG_SCHEMA_VERSION)});
+    CHECK(queryRows(DATABASE_NAME, R"(SELECT count(*) FROM sqlite_master WHERE name IN ('PKG_INFO', 'PREV_VERSIONS', 'DEPENDENCY_MAP');)") ==
+          vector<string>{"0"});
+    CHECK(queryRows(DATABASE_NAME, R"(SELECT count(*) FROM "PACKAGES" WHERE BLOCK_HASH IS NULL;)") == vector<string>{"2"});
+    CHECK(queryRows(DATABASE_NAME, R"(SELECT count(*) FROM "VERSIONS" WHERE VERSION_KEY IS NULL;)") == vector<string>{"0"});
+
+    removeDatabase(DATABASE_NAME);
+}
+
+/**
+ * A version listed twice in setup.ini is stored twice. getPackageRecords() & the getters both take the first one,
+ * and ordering by it still lets lookups use indexes. getPackageRecords() also finds the current version by its number
+ */
+static void testDuplicateVersions()
+{
+    const char *SETUPINI_NAME = "test_duplicates.ini";
+    const char *DATABASE_NAME = "test_duplicates.db";
+
+    writeFile(SETUPINI_NAME, string(SETUPINI_HEADER) +
+                                 "@ bash\n"
+                                 "sdesc: \"The GNU Bourne Again SHell\"\n"
+                                 "category: Base\n"
+                                 "version: 4.4.12-3\n"
+                                 "install: x86_64/release/bash/bash-4.4.12-3.tar.xz 1234 abcd\n"
+                                 "[prev]\n"
+                                 "version: 4.4.11-1\n"
+                                 "install: x86_64/release/bash/first.tar.xz 1200 ef01\n"
+                                 "[prev]\n"
+                                 "version: 4.4.11-1\n"
+                                 "install: x86_64/release/bash/second.tar.xz 1300 ef02\n"
+                                 "\n");
+    buildDatabase(DATABASE_NAME, SETUPINI_NAME, PARSE_MODE_STREAM);
+
+    {
+        CygpmDatabase catalog(DATABASE_NAME);
+        CHECK(catalog.createIndexes() == SQLITE_OK);
+        CHECK(catalog.checkQueryPlans() == 0);
+
+        char *path = catalog.getInstallPakPath("bash", "4.4.11-1");
+        CHECK(path != NULL && string(path) == "x86_64/release/bash/first.tar.xz");
+        free(path);
+
+        vector<PackageRecord> records;
+        CHECK(catalog.getPackageRecords({"bash", "nonexistent", "bash"}, "4.4.11-1", records) == SQLITE_OK);
+        CHECK(records.size() == 3);
+        CHECK(records.size() == 3 && records[0].found && records[0].install.path == "x86_64/release/bash/first.tar.xz");
+        CHECK(records.size() == 3 && !records[1].found);
+        CHECK(records.size() == 3 && records[2].found && records[2].install.sha512 == "ef01");
+
+        CHECK(catalog.getPackageRecords({"bash"}, "4.4.12-3", records) == SQLITE_OK);
+        CHECK(records.size() == 1 && records[0].found && records[0].install.path == "x86_64/release/bash/bash-4.4.12-3.tar.xz");
+        CHECK(records.size() == 1 && records[0].sdesc == "\"The GNU Bourne Again SHell\"");
+    }
+
+    remove(SETUPINI_NAME);
+    removeDatabase(DATABASE_NAME);
+}
+
+/**
+ * Both resolver modes list dependencies in the same depth-first order: A package, then the subtree of each of
+ * its dependencies in turn. Packages listed before the call are neither added nor expanded, and a cycle
+ * back to the package itself ends the walk
+ */
+static void testResolverModesAgree()
+{
+    const char *SETUPINI_NAME = "test_resolver.ini";
+    const char *DATABASE_NAME = "test_resolver.db";
+
+    writeFile(SETUPINI_NAME, string(SETUPINI_HEADER) +
+                                 "@ a\n"
+                                 "requires: b c\n"
+                                 "version: 1.0-1\n"
+                                 "[prev]\n"
+                                 "version: 0.9-1\n"
+                                 "depends2: f\n"
+                                 "\n"
+                                 "@ b\n"
+                                 "requires: c e x\n"
+                                 "version: 1.0-1\n"
+                                 "\n"
+                                 "@ c\n"
+                                 "requires: d\n"
+                                 "version: 1.0-1\n"
+                                 "\n"
+                                 "@ d\n"
+                                 "version: 1.0-1\n"
+                                 "\n"
+                                 "@ e\n"
+                                 "requires: a\n"
+                                 "version: 1.0-1\n"
+                                 "\n"
+                                 "@ x\n"
+                                 "requires: f\n"
+                                 "version: 1.0-1\n"
+                                 "\n"
+                                 "@ f\n"
+                                 "version: 1.0-1\n"
+                                 "\n");
+    buildDatabase(DATABASE_NAME, SETUPINI_NAME, PARSE_MODE_STREAM);
+
+    {
+        CygpmDatabase catalog(DATABASE_NAME);
+        const ResolverMode MODES[] = {RESOLVER_MODE_WALK, RESOLVER_MODE_CTE};
+
+        for (ResolverMode mode : MODES)
+        {
+            catalog.setResolverMode(mode);
+
+            vector<string> dependencies;
+            CHECK(catalog.findDependencies(dependencies, "a", NULL) == 0);
+            CHECK(dependencies == (vector<string>{"a", "b", "c", "d", "e", "x", "f"}));
+
+            dependencies = {"x"};
+            CHECK(catalog.findDependencies(dependencies, "a", NULL) == 0);
+            CHECK(dependencies == (vector<string>{"x", "a", "b", "c", "d", "e"}));
+
+            dependencies.clear();
+            CHECK(catalog.findDependencies(dependencies, "a", "0.9-1") == 0);
+            CHECK(dependencies == (vector<string>{"a", "f"}));
+
+            dependencies = {"a"};
+            CHECK(catalog.findDependencies(dependencies, "a", NULL) == 1);
+            CHECK(dependencies == vector<string>{"a"});
+        }
+    }
+
+    remove(SETUPINI_NAME);
+    removeDatabase(DATABASE_NAME);
+}
+
+/**
+ * A full rebuild is one transaction: Readers see the old catalog until it's committed complete with its indexes,
+ * and a failed rebuild leaves the old catalog as it was
+ */
+static void testFullRebuildIsAtomic()
+{
+    const char *SETUPINI_NAME = "test_rebuild.ini";
+    const char *DATABASE_NAME = "test_rebuild.db";
+    const char *SQL_LIST_PACKAGES = R"(SELECT N.NAME FROM "PACKAGES" P JOIN "PACKAGE_NAMES" N ON N.ID = P.ID ORDER BY 1;)";
+    const char *SQL_COUNT_INDEXES = R"(SELECT count(*) FROM sqlite_master WHERE type = 'index' AND name LIKE 'IDX\_%' ESCAPE '\';)";
+
+    writeFile(SETUPINI_NAME, string(SETUPINI_HEADER) +
+                                 "@ old\n"
+                                 "version: 1.0-1\n"
+                                 "\n");
+    buildDatabase(DATABASE_NAME, SETUPINI_NAME, PARSE_MODE_STREAM);
+
+    writeFile(SETUPINI_NAME, string(SETUPINI_HEADER) +
+                                 "@ new\n"
+                                 "version: 1.0-1\n"
+                                 "\n");
+
+    {
+        CygpmDatabase catalog(DATABASE_NAME);
+
+        CHECK(catalog.createTable() == 0);
+        CHECK(queryRows(DATABASE_NAME, SQL_LIST_PACKAGES) == vector<string>{"old"});
+        CHECK(catalog.parseAndBuildDatabase("test_nonexistent.ini") < 0);
+        CHECK(queryRows(DATABASE_NAME, SQL_LIST_PACKAGES) == vector<string>{"old"});
+        CHECK(catalog.getNumPackages() == 1);
+
+        CHECK(catalog.createTable() == 0);
+        CHECK(catalog.parseAndBuildDatabase(SETUPINI_NAME) == 1);
+        CHECK(queryRows(DATABASE_NAME, SQL_LIST_PACKAGES) == vector<string>{"new"});
+        CHECK(queryRows(DATABASE_NAME, SQL_COUNT_INDEXES) == vector<string>{"4"});
+    }
+
+    remove(SETUPINI_NAME);
+    removeDatabase(DATABASE_NAME);
+}
+
+/**
+ * compareVersions() orders versions as rpmvercmp does, and keys of makeVersionKey() sort the same way byte by byte,
+ * as SQLite compares BLOBs. Cases are rpmvercmp's own, followed by epochs & releases
+ */
+static int sign(int value)
+{
+    return value < 0 ? -1 : (value > 0 ? 1 : 0);
+}
+
+static int compareKeys(const string &a, const string &b) // As memcmp(), then the shorter one first
+{
+    int result = memcmp(a.data(), b.data(), min(a.length(), b.length()));
+    if (result != 0)
+        return result;
+    return a.length() < b.length() ? -1 : (a.length() > b.length() ? 1 : 0);
+}
+
+static void testVersionOrder()
+{
+    struct Case
+    {
+        const char *a;
+        const char *b;
+        int expected; // Sign of comparing a with b
+    };
+    const Case CASES[] = {
+        /* rpmvercmp */
+        {"1.0", "1.0", 0}, {"1.0", "2.0", -1}, {"2.0.1", "2.0.1", 0}, {"2.0", "2.0.1", -1},
+        {"2.0.1a", "2.0.1a", 0}, {"2.0.1a", "2.0.1", 1}, {"5.5p1", "5.5p2", -1}, {"5.5p10", "5.5p10", 0},
+        {"5.5p1", "5.5p10", -1}, {"10xyz", "10.1xyz", -1}, {"xyz10", "xyz10", 0}, {"xyz10", "xyz10.1", -1},
+        {"xyz.4", "xyz.4", 0}, {"xyz.4", "8", -1}, {"xyz.4", "2", -1}, {"5.5p2", "5.6p1", -1},
+        {"5.6p1", "6.5p1", -1}, {"6.0.rc1", "6.0", 1}, {"10b2", "10a1", 1}, {"10a2", "10b2", -1},
+        {"1.0aa", "1.0aa", 0}, {"1.0a", "1.0aa", -1}, {"10.0001", "10.0001", 0}, {"10.0001", "10.1", 0},
+        {"10.0001", "10.0039", -1}, {"4.999.9", "5.0", -1}, {"20101121", "20101122", -1}, {"2_0", "2_0", 0},
+        {"2.0", "2_0", 0}, {"a+", "a_", 0}, {"+a", "_a", 0}, {"_+", "+_", 0}, {"+", "_", 0},
+        {"1.0~rc1", "1.0~rc1", 0}, {"1.0~rc1", "1.0", -1}, {"1.0~rc1", "1.0~rc2", -1}, {"1.0~rc1~git123", "1.0~rc1", -1},
+
+        /* Letters against numbers, leading zeros, "~" */
+        {"1.a", "1.0", -1}, {"1.0a", "1.0.1", -1}, {"1.01", "1.1", 0}, {"1.010", "1.9", 1}, {"2.0~", "2.0", -1},
+        {"1.0~rc1-1", "1.0-1", -1}, {"1.0-1~beta", "1.0-1", -1}, {"1.0~~", "1.0~", -1},
+
+        /* Epochs */
+        {"1:1.0-1", "2.0-1", 1}, {"0:1.0-1", "1.0-1", 0}, {"01:1.0-1", "1:1.0-1", 0}, {"2:0.1-1", "10:0.1-1", -1},
+
+        /* Releases, including a missing one */
+        {"1.0-1", "1.0-2", -1}, {"1.0-10", "1.0-9", 1}, {"1.0", "1.0-1", -1}, {"1.0-0", "1.0", 1},
+        {"4.4.12-3", "4.4.12-3", 0}, {"4.4.12-3", "4.4.9-10", 1}, {"foo-bar-1", "foo-bar-2", -1},
+    };
+
+    for (const Case &c : CASES)
+    {
+        string key_a, key_b;
+        makeVersionKey(c.a, key_a);
+        makeVersionKey(c.b, key_b);
+
+        int forward = sign(compareVersions(c.a, c.b));
+        int backward = sign(compareVersions(c.b, c.a));
+        int by_key = sign(compareKeys(key_a, key_b));
+        if (forward != c.expected || backward != -c.expected || by_key != c.expected)
+            cerr << "Version order of " << c.a << " & " << c.b << ":" << endl; // Which case the checks below fail on
+
+        CHECK(forward == c.expected);
+        CHECK(backward == -c.expected);
+        CHECK(by_key == c.expected);
+    }
+}
+
+/**
+ * Regex search matches escapes by what they stand for (not by their operands, when picking a literal to
+ * pre-filter with), ignoring case as the other searches do
+ */
+static void testRegexSearch()
+{
+    const char *SETUPINI_NAME = "test_regex.ini";
+    const char *DATABASE_NAME = "test_regex.db";
+
+    writeFile(SETUPINI_NAME, string(SETUPINI_HEADER) +
+                                 "@ alpha\n"
+                                 "sdesc: \"Model ABCD-1, made by Foo\"\n"
+                                 "version: 1.0-1\n"
+                                 "\n"
+                                 "@ beta\n"
+                                 "sdesc: \"Model 4142-1\"\n"
+                                 "version: 1.0-1\n"
+                                 "\n");
+    buildDatabase(DATABASE_NAME, SETUPINI_NAME, PARSE_MODE_STREAM);
+
+    {
+        CygpmDatabase catalog(DATABASE_NAME);
+        vector<string> pkg_names;
+
+        CHECK(catalog.searchPackagesByRegex(R"(\x41BCD)", pkg_names) == SQLITE_OK);
+        CHECK(pkg_names == vector<string>{"alpha"});
+        CHECK(catalog.searchPackagesByRegex(R"(\u0041BCD-\d)", pkg_names) == SQLITE_OK);
+        CHECK(pkg_names == vector<string>{"alpha"});
+        CHECK(catalog.searchPackagesByRegex(R"(\x34142)", pkg_names) == SQLITE_OK); // "4142"
+        CHECK(pkg_names == vector<string>{"beta"});
+
+        CHECK(catalog.searchPackagesByRegex("model abcd", pkg_names) == SQLITE_OK);
+        CHECK(pkg_names == vector<string>{"alpha"});
+        CHECK(catalog.searchPackagesByRegex("made by FOO", pkg_names) == SQLITE_OK);
+        CHECK(pkg_names == vector<string>{"alpha"});
+    }
+
+    remove(SETUPINI_NAME);
+    removeDatabase(DATABASE_NAME);
+}
+
+/**
+ * A saved dependency graph reads back the same, and one whose offsets or edges are out of range is refused
+ */
+static void testBrokenDependencyGraph()
+{
+    const char *GRAPH_NAME = "test.dgr";
+
+    DependencyGraph saved;
+    saved.assign({"a", "b", "c"}, {{0, 1}, {1, 2}}, 42);
+    CHECK(saved.save(GRAPH_NAME) == CPM_OK);
+
+    DependencyGraph graph;
+    CHECK(graph.open(GRAPH_NAME, 42) == CPM_OK);
+    CHECK(graph.getNumNodes() == 3 && graph.getNumEdges() == 2);
+    CHECK(graph.findNode("b") == 1 && graph.getDependencies(1).size() == 1 && *graph.getDependencies(1).begin() == 2);
+    CHECK(graph.open(GRAPH_NAME, 43) == CPM_INDEX_OUTDATED);
+    graph.clear();
+
+    // The 32-byte header is followed by name offsets [4], forward offsets [4] & forward edges [2]
+    auto patch = [&](size_t offset, uint32_t value) {
+        CHECK(saved.save(GRAPH_NAME) == CPM_OK);
+        fstream file(GRAPH_NAME, ios::in | ios::out | ios::binary);
+        file.seekp(offset);
+        file.write((const char *)&value, sizeof(value));
+    };
+
+    patch(32 + 4 * 4 + 4, 5); // Forward offsets go backwards
+    CHECK(graph.open(GRAPH_NAME, 42) == CPM_FILE_ACCESS_ERROR);
+    patch(32 + 4 * 3, 2); // Name offsets end before the name pool does
+    CHECK(graph.open(GRAPH_NAME, 42) == CPM_FILE_ACCESS_ERROR);
+    patch(32 + 4 * 8, 7); // An edge to node 7 of 3
+    CHECK(graph.open(GRAPH_NAME, 42) == CPM_FILE_ACCESS_ERROR);
+
+    remove(GRAPH_NAME);
+}
+
+/**
+ * Likewise for the catalog cache: strings, dependency offsets & dependencies must stay within their arrays
+ */
+static void testBrokenCatalogCache()
+{
+    const char *CACHE_NAME = "test.cache";
+
+    DependencyGraph graph;
+    graph.assign({"a", "b", "c"}, {{0, 1}, {1, 2}}, 42);
+    vector<PackageRecord> records(3);
+    records[0].found = true;
+    records[0].version = "1.0-1";
+    records[0].sdesc = "\"Package a\"";
+
+    CHECK(CatalogCache::write(CACHE_NAME, graph, records) == CPM_OK);
+    CatalogCache cache;
+    CHECK(cache.open(CACHE_NAME, (uint64_t)42) == CPM_OK);
+    CatalogCache::Package pkg;
+    CHECK(cache.lookup("a", pkg) && pkg.version == "1.0-1" && pkg.sdesc == "\"Package a\"");
+    CHECK(!cache.lookup("b", pkg) && cache.getDependencies(cache.find("b")).size() == 1);
+    cache.close();
+
+    // The 32-byte header is followed by names [3] of 8 bytes, records [3] of 80 bytes,
+    // dependency offsets [4] & dependencies [2]
+    auto patch = [&](size_t offset, uint32_t value) {
+        CHECK(CatalogCache::write(CACHE_NAME, graph, records) == CPM_OK);
+        fstream file(CACHE_NAME, ios::in | ios::out | ios::binary);
+        file.seekp(offset);
+        file.write((const char *)&value, sizeof(value));
+    };
+
+    patch(32 + 4, UINT32_MAX); // First name runs past the string pool
+    CHECK(cache.open(CACHE_NAME, (uint64_t)42) == CPM_FILE_ACCESS_ERROR);
+    patch(296 + 4, 5); // Dependency offsets go backwards
+    CHECK(cache.open(CACHE_NAME, (uint64_t)42) == CPM_FILE_ACCESS_ERROR);
+    patch(296 + 4 * 3, 1); // Dependency offsets end before the dependencies do
+    CHECK(cache.open(CACHE_NAME, (uint64_t)42) == CPM_FILE_ACCESS_ERROR);
+    patch(312, 7); // A dependency on name 7 of 3
+    CHECK(cache.open(CACHE_NAME, (uint64_t)42) == CPM_FILE_ACCESS_ERROR);
+
+    remove(CACHE_NAME);
+}
+
+int main()
+{
+    testVersionOrder();
+    testParseModesAgree();
+    testMigrateBaselineDatabase();
+    testDuplicateVersions();
+    testResolverModesAgree();
+    testFullRebuildIsAtomic();
+    testRegexSearch();
+    testBrokenDependencyGraph();
+    testBrokenCatalogCache();
+
+    if (numFailures == 0)
+        cout << "All tests passed" << endl;
+    else
+        cout << numFailures << " check(s) failed" << endl;
+
+    return numFailures == 0 ? 0 : 1;
+}
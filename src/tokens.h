@@ -8,12 +8,45 @@
 typedef enum {
     T_Package_Name = 256,       
     T_Quotation_Mark,
-    T_YAML_Key,
     T_Prev_Version_Mark,
     T_Multiline_String,
     T_Word,
-    T__Ignored
+    T__Ignored,
+    T_YAML_Key = 512            // A YAML key. Known keys are T_YAML_Key + YAMLKeyId, see below
 } TokenType;
 
+/**
+ * IDs of YAML keys we handle.
+ * The lexer matches each of them by its own rule, so the key is resolved by flex's DFA
+ * while scanning. Parsers never compare key strings.
+ */
+typedef enum {
+    YAML_KEY_UNKNOWN = 0,       // Any other key. Ignored by parsers
+
+    /* Package items */
+    YAML_KEY_SDESC,
+    YAML_KEY_LDESC,
+    YAML_KEY_CATEGORY,
+    YAML_KEY_REQUIRES,
+    YAML_KEY_VERSION,
+    YAML_KEY_INSTALL,
+    YAML_KEY_SOURCE,
+    YAML_KEY_DEPENDS2,
+    YAML_KEY_OBSOLETES,
+    YAML_KEY_PROVIDES,
+    YAML_KEY_CONFLICTS,
+
+    /* setup.ini's header */
+    YAML_KEY_RELEASE,
+    YAML_KEY_ARCH,
+    YAML_KEY_SETUP_TIMESTAMP,
+    YAML_KEY_SETUP_MINIMUM_VERSION,
+    YAML_KEY_SETUP_VERSION,
+
+    NUM_YAML_KEYS
+} YAMLKeyId;
+
+#define YAML_KEY_TOKEN(key_id) (T_YAML_Key + (key_id))                   // Token type of a YAML key
+#define YAML_KEY_ID(token_type) ((YAMLKeyId)((token_type) - T_YAML_Key)) // YAML key's ID from its token type
 
 #endif
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "utils.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
 char *ltrim(char *source)
 {
     char *p = source;
@@ -17,7 +23,15 @@ char *rtrim(char *source)
     return source;
 }
 
-bool isInVector_string(vector<string> vector, const char *item)
+string_view rtrimView(string_view source)
+{
+    while (!source.empty() && isspace((unsigned char)source.back()))
+        source.remove_suffix(1);
+
+    return source;
+}
+
+bool isInVector_string(const vector<string> &vector, const char *item)
 {
     for (auto i = vector.begin(); i != vector.end(); i++)
         if (i->compare(item) == 0)
@@ -39,6 +53,99 @@ bool isFileExist(const char *fileName)
     return false;
 }
 
+long getPeakRSS_KB()
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+
+    return usage.ru_maxrss; // Already in KB on Linux & Cygwin
+}
+
+int mapFileForScan(const char *fileName, MappedFile &mappedFile)
+{
+    struct stat file_stat;
+    int fd;
+
+    /* Open & check if opening error */
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return CPM_FILE_ACCESS_ERROR;
+
+    if (fstat(fd, &file_stat) != 0)
+    {
+        close(fd);
+        return CPM_FILE_ACCESS_ERROR;
+    }
+
+    mappedFile.size = file_stat.st_size;
+    mappedFile.is_mapped = false;
+
+    /**
+     * Flex requires the scanned buffer to end with two '\0's.
+     * Bytes between EOF and the end of the last page are zero-filled by mmap(),
+     * so we can map the file directly if there're at least 2 such bytes.
+     *
+     * Mapping is private & writable, since Flex temporarily writes '\0' after each token.
+     * Modified pages are copied on write, the file itself is never touched.
+     */
+    if (mappedFile.size % getpagesize() != 0 && mappedFile.size % getpagesize() <= (size_t)getpagesize() - 2)
+    {
+        void *addr = mmap(NULL, mappedFile.size + 2, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            mappedFile.data = (char *)addr;
+            mappedFile.is_mapped = true;
+        }
+    }
+
+    /**
+     * Fallback: Read the whole file into a heap buffer.
+     */
+    if (!mappedFile.is_mapped)
+    {
+        mappedFile.data = new char[mappedFile.size + 2];
+
+        size_t nRead = 0;
+        while (nRead < mappedFile.size)
+        {
+            ssize_t n = read(fd, mappedFile.data + nRead, mappedFile.size - nRead);
+            if (n <= 0)
+                break;
+            nRead += n;
+        }
+
+        if (nRead != mappedFile.size)
+        {
+            close(fd);
+            unmapFile(mappedFile);
+            return CPM_FILE_ACCESS_ERROR;
+        }
+
+        mappedFile.data[mappedFile.size] = '\0';
+        mappedFile.data[mappedFile.size + 1] = '\0';
+    }
+
+    close(fd);
+    return CPM_OK;
+}
+
+void unmapFile(MappedFile &mappedFile)
+{
+    if (mappedFile.data == NULL)
+        return;
+
+    if (mappedFile.is_mapped)
+        munmap(mappedFile.data, mappedFile.size + 2);
+    else
+        delete[] mappedFile.data;
+
+    mappedFile.data = NULL;
+    mappedFile.size = 0;
+    mappedFile.is_mapped = false;
+}
+
 string calculateFileSHA512(string fileName)
 {
     ifstream in(fileName, ios::binary);
@@ -53,6 +160,59 @@ string calculateFileSHA512(string fileName)
     return sha512(file_data.str());
 }
 
+uint64_t fnv1a64(const char *data, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL; // FNV offset basis
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL; // FNV prime
+    }
+
+    return hash;
+}
+
+size_t decodeHex(const char *hex, size_t length, unsigned char *output, size_t outputSize)
+{
+    if (length == 0 || length % 2 != 0 || length / 2 > outputSize)
+        return 0;
+
+    for (size_t i = 0; i < length; i += 2)
+    {
+        int nibbles[2];
+        for (int j = 0; j < 2; j++)
+        {
+            char c = hex[i + j];
+            if (c >= '0' && c <= '9')
+                nibbles[j] = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                nibbles[j] = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                nibbles[j] = c - 'A' + 10;
+            else
+                return 0;
+        }
+        output[i / 2] = (unsigned char)(nibbles[0] << 4 | nibbles[1]);
+    }
+
+    return length / 2;
+}
+
+string encodeHex(const unsigned char *data, size_t length)
+{
+    static const char DIGITS[] = "0123456789abcdef";
+    string hex(length * 2, '\0');
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hex[i * 2] = DIGITS[data[i] >> 4];
+        hex[i * 2 + 1] = DIGITS[data[i] & 0x0f];
+    }
+
+    return hex;
+}
+
 int extractTextFromGzip(const char *fileName, vector<string> &result)
 {
     /**
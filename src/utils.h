@@ -11,8 +11,10 @@ enum InstallerErrors
 {
     CPM_OK = 0,
     CPM_FILE_NOT_EXIST = 16,
+    CPM_FILE_ACCESS_ERROR,
     CPM_EXTERNAL_PROGRAM_FAILED,
     CPM_DECOMPRESS_ERROR,
+    CPM_INDEX_OUTDATED,
     CPM_UNEXPECTED_ERROR
 };
 
@@ -21,17 +23,35 @@ enum InstallerErrors
  */
 char *ltrim(char *source); // Remove leading spaces
 char *rtrim(char *source); // Remove trailing spaces
+string_view rtrimView(string_view source); // Remove trailing spaces, without copying
 
 /**
  * Common-use procedures
  */
-bool isInVector_string(vector<string> vector, const char *item); // Check if an string item is in vector
-bool isFileExist(const char *fileName);                          // Check if a file exists
+bool isInVector_string(const vector<string> &vector, const char *item); // Check if an string item is in vector
+bool isFileExist(const char *fileName);                                 // Check if a file exists
+long getPeakRSS_KB();                                                   // Get peak resident set size of this process, in KB
+
+/**
+ * Memory-mapped files
+ */
+struct MappedFile
+{
+    char *data = NULL;      // File content. Always followed by two '\0's, as required by yy_scan_buffer()
+    size_t size = 0;        // File size, excluding the two trailing '\0's
+    bool is_mapped = false; // Whether data is a real mapping. If false, it's a heap buffer (fallback)
+};
+
+int mapFileForScan(const char *fileName, MappedFile &mappedFile); // Map a file into memory, making it scannable in place by Flex
+void unmapFile(MappedFile &mappedFile);                            // Release a file mapped by mapFileForScan()
 
 /**
  * Data tools
  */
 string calculateFileSHA512(string fileName);                           // Calculate a file's SHA512
+uint64_t fnv1a64(const char *data, size_t length);                     // Fast 64-bit FNV-1a hash, for fingerprints (not for security)
+size_t decodeHex(const char *hex, size_t length, unsigned char *output, size_t outputSize); // Decode a hex string into bytes. Returns byte count, 0 if it's not valid hex
+string encodeHex(const unsigned char *data, size_t length);             // Encode bytes into a lowercase hex string
 int extractTextFromGzip(const char *fileName, vector<string> &result); // Extract a gzip-compressed text file's content into vector
 
 #endif
\ No newline at end of file